@@ -0,0 +1,45 @@
+#include "arena.h"
+
+void Arena::Reset()
+{
+    if (blocks_.size() > 1)
+    {
+        size_t total = Capacity();
+        blocks_.resize(1);
+        if (total <= MAX_RETAINED_SIZE_)
+        {
+            blocks_.clear();
+            AddBlock(total);
+        }
+    }
+    if (!blocks_.empty())
+    {
+        ptr_ = blocks_[0].data.get();
+        end_ = ptr_ + blocks_[0].size;
+    }
+}
+
+size_t Arena::Capacity() const
+{
+    size_t total = 0;
+    for (const Block &block : blocks_)
+    {
+        total += block.size;
+    }
+    return total;
+}
+
+void *Arena::AllocateSlow(size_t size, size_t align)
+{
+    // 新块的大小至少是已有内存的总量，块数按对数增长
+    AddBlock(std::max(std::max(block_size_, Capacity()), size + align));
+    return Allocate(size, align);
+}
+
+void Arena::AddBlock(size_t size)
+{
+    // 块的内容不需要清零，因此不用 make_unique
+    blocks_.push_back({std::unique_ptr<char[]>(new char[size]), size});
+    ptr_ = blocks_.back().data.get();
+    end_ = ptr_ + size;
+}
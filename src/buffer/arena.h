@@ -0,0 +1,96 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 连接私有的线性分配器：请求处理过程中的临时字符串（路径、表单的键值、文件的完整路径、错误页面等）
+// 依次从当前块中切出，不单独释放，一个请求处理完后由 Reset() 整体回收
+// 第一次分配时才申请内存；当前块不够用时申请新的块，Reset() 时把所有块合并成一个足够大的块，
+// 之后同样大小的请求不再调用全局的分配器
+class Arena
+{
+public:
+    explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE_) : ptr_(nullptr), end_(nullptr), block_size_(block_size)
+    {
+    }
+
+    ~Arena() = default;
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    // 分配 size 字节，按 align（2 的幂）对齐，内存在 Reset() 之前有效
+    void *Allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        uintptr_t pos = (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+        if (ptr_ == nullptr || pos + size > reinterpret_cast<uintptr_t>(end_))
+        {
+            return AllocateSlow(size, align);
+        }
+        ptr_ = reinterpret_cast<char *>(pos + size);
+        return reinterpret_cast<void *>(pos);
+    }
+
+    // 分配 len 字节的字符数组，不需要对齐
+    char *AllocateChars(size_t len)
+    {
+        return static_cast<char *>(Allocate(len, 1));
+    }
+
+    // 复制字符串，返回的 string_view 在 Reset() 之前有效
+    std::string_view Copy(std::string_view str)
+    {
+        char *data = AllocateChars(str.size());
+        memcpy(data, str.data(), str.size());
+        return std::string_view(data, str.size());
+    }
+
+    // 拼接两个字符串并以 '\0' 结尾，用于传给 stat()、open() 等系统调用的路径
+    const char *Join(std::string_view a, std::string_view b)
+    {
+        char *data = AllocateChars(a.size() + b.size() + 1);
+        memcpy(data, a.data(), a.size());
+        memcpy(data + a.size(), b.data(), b.size());
+        data[a.size() + b.size()] = '\0';
+        return data;
+    }
+
+    // 回收所有分配出去的内存；用到了多个块时合并成一个，合并后超过 MAX_RETAINED_SIZE_ 的只保留第一个块
+    void Reset();
+
+    // 已经申请的内存总量
+    size_t Capacity() const;
+
+private:
+    void *AllocateSlow(size_t size, size_t align);
+
+    // 申请 size 字节的新块作为当前块
+    void AddBlock(size_t size);
+
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks_;     // 最后一个块是当前块
+
+    char *ptr_;                     // 当前块中下一个可分配的位置
+
+    char *end_;
+
+    size_t block_size_;             // 第一个块的最小大小
+
+    static constexpr size_t DEFAULT_BLOCK_SIZE_ = 4096;
+
+    static constexpr size_t MAX_RETAINED_SIZE_ = 1 << 16;
+};
+
+#endif
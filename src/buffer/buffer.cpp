@@ -57,9 +57,9 @@ void Buffer::Append(const char *str, size_t len)
     UpdateWritePos(len);
 }
 
-void Buffer::Append(const std::string &str)
+void Buffer::Append(std::string_view str)
 {
-    Append(str.c_str(), str.length());
+    Append(str.data(), str.length());
 }
 
 void Buffer::Append(const void *data, size_t len)
@@ -85,6 +85,13 @@ void Buffer::RetrieveUntil(const char *end)
     Retrieve(end - GetReadPtr());
 }
 
+void Buffer::Erase(size_t offset, size_t len)
+{
+    assert(offset + len <= ReadableBytes());
+    std::copy(GetReadPtr() + offset + len, GetWritePtr(), GetReadPtr() + offset);
+    write_pos_ -= len;
+}
+
 void Buffer::RetrieveAll()
 {
     std::fill(buffer_.begin(), buffer_.end(), 0);
@@ -92,6 +99,13 @@ void Buffer::RetrieveAll()
     write_pos_ = 0;
 }
 
+void Buffer::Reallocate()
+{
+    std::vector<char>(buffer_.size()).swap(buffer_);
+    read_pos_ = 0;
+    write_pos_ = 0;
+}
+
 std::string Buffer::RetrieveAllToStr()
 {
     std::string str(GetReadPtr(), ReadableBytes());
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <atomic>
 #include <sys/uio.h> // struct iovec
 #include <cassert>
@@ -25,7 +26,8 @@ public:
     void Append(const char *str, size_t len);
 
     // 将字符串追加到缓冲区中，调用 void Append(const char *str, size_t len)
-    void Append(const std::string &str);
+    // 参数为 string_view，追加字符串字面量时不会构造临时的 std::string
+    void Append(std::string_view str);
 
     // 将数据追加到缓冲区中，调用 void Append(const char *str, size_t len)
     void Append(const void *data, size_t len);
@@ -39,9 +41,15 @@ public:
     // 读取到了 end 位置，修改读位置
     void RetrieveUntil(const char *end);
 
+    // 删除可读数据中从 offset 开始的 len 字节，之后的数据前移，之前的数据保持不变
+    void Erase(size_t offset, size_t len);
+
     // 清空缓冲区，将读写指针重置为初始位置
     void RetrieveAll();
 
+    // 在调用线程上重新分配同样大小的缓冲区并清空，新内存由调用线程第一次写入 (first-touch)
+    void Reallocate();
+
     // 清空缓冲区并返回缓冲区中的数据
     std::string RetrieveAllToStr();
 
@@ -1,6 +1,7 @@
 #include "epoller.h"
 
-Epoller::Epoller(int max_events) : epoll_fd_(epoll_create(512)), events_(max_events)
+Epoller::Epoller(int max_events, size_t max_fd) : epoll_fd_(epoll_create(512)), events_(max_events), max_fd_(max_fd),
+        states_(std::make_unique<FdState[]>(max_fd)), ctl_count_(0), saved_count_(0)
 {
     assert(epoll_fd_ >= 0 && events_.size() > 0);
 }
@@ -13,31 +14,129 @@ Epoller::~Epoller()
 bool Epoller::AddFd(int fd, uint32_t event)
 {
     if (fd < 0) return false;
-    struct epoll_event ev = {0};
-    ev.data.fd = fd;
-    ev.events = event;
-    return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+    return Control(fd, EPOLL_CTL_ADD, event);
 }
 
 bool Epoller::ModifyFd(int fd, uint32_t event)
 {
     if (fd < 0) return false;
-    struct epoll_event ev = {0};
-    ev.data.fd = fd;
-    ev.events = event;
-    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+    FdState *state = GetState(fd);
+    if (!state)
+    {
+        return Control(fd, EPOLL_CTL_MOD, event);
+    }
+    // 立即修改会覆盖之前推迟的修改
+    state->is_pending = false;
+    if (!state->is_registered)
+    {
+        return Control(fd, EPOLL_CTL_ADD, event);
+    }
+    if (state->event == event && state->is_armed)
+    {
+        saved_count_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return Control(fd, EPOLL_CTL_MOD, event);
+}
+
+void Epoller::DeferModifyFd(int fd, uint32_t event)
+{
+    FdState *state = GetState(fd);
+    if (!state)
+    {
+        ModifyFd(fd, event);
+        return;
+    }
+    if (state->is_pending)
+    {
+        // 同一轮内的上一次修改被覆盖，不必提交
+        saved_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        state->is_pending = true;
+        pending_fds_.push_back(fd);
+    }
+    state->pending_event = event;
+}
+
+bool Epoller::RearmFd(int fd)
+{
+    FdState *state = GetState(fd);
+    if (!state || !state->is_registered)
+    {
+        return false;
+    }
+    state->is_pending = false;
+    return Control(fd, EPOLL_CTL_MOD, state->event);
 }
 
 bool Epoller::DeleteFd(int fd)
 {
     if (fd < 0) return false;
+    FdState *state = GetState(fd);
+    if (state)
+    {
+        state->is_pending = false;
+        if (!state->is_registered)
+        {
+            saved_count_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return Control(fd, EPOLL_CTL_DEL, 0);
+}
+
+bool Epoller::Control(int fd, int op, uint32_t event)
+{
     struct epoll_event ev = {0};
-    return epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, &ev) == 0;
+    ev.data.fd = fd;
+    ev.events = event;
+    FdState *state = GetState(fd);
+    if (state)
+    {
+        // 必须在 epoll_ctl 之前更新：调用返回前事件就可能触发，事件循环线程会在 Wait() 中把 fd 标记为未激活
+        state->event = event;
+        state->is_armed = true;
+        state->is_registered = op != EPOLL_CTL_DEL;
+    }
+    ctl_count_.fetch_add(1, std::memory_order_relaxed);
+    bool res = epoll_ctl(epoll_fd_, op, fd, &ev) == 0;
+    if (state && !res)
+    {
+        // 失败时 fd 可能已被关闭或不在 epoll 中，都当作未注册处理，下次修改时重新加入
+        state->is_registered = false;
+    }
+    return res;
+}
+
+void Epoller::FlushPending()
+{
+    for (int fd : pending_fds_)
+    {
+        FdState *state = GetState(fd);
+        if (state->is_pending)
+        {
+            ModifyFd(fd, state->pending_event);
+        }
+    }
+    pending_fds_.clear();
 }
 
 int Epoller::Wait(int timeout_ms)
 {
-    return epoll_wait(epoll_fd_, &events_[0], static_cast<int>(events_.size()), timeout_ms);
+    FlushPending();
+    int n = epoll_wait(epoll_fd_, &events_[0], static_cast<int>(events_.size()), timeout_ms);
+    for (int i = 0; i < n; ++i)
+    {
+        FdState *state = GetState(events_[i].data.fd);
+        if (state && (state->event & EPOLLONESHOT))
+        {
+            // EPOLLONESHOT 的 fd 触发后被内核禁用，需要再 MOD 一次才能继续触发
+            state->is_armed = false;
+        }
+    }
+    return n;
 }
 
 int Epoller::GetEventFd(size_t i) const
@@ -3,33 +3,91 @@
 
 #include <sys/epoll.h>
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cassert>
 
+// 对 epoll 的封装，并记录每个 fd 当前注册的事件，省去不会改变任何状态的 epoll_ctl 调用：
+// - 事件相同且 fd 仍处于激活状态（未设置 EPOLLONESHOT，或设置了但还没有触发过）时，ModifyFd 直接返回
+// - 已经移除的 fd 不再调用 EPOLL_CTL_DEL
+// - 事件循环线程自己发起的修改可以用 DeferModifyFd 推迟到下一次 Wait() 之前统一提交，
+//   同一轮内对同一 fd 的多次修改只提交最后一次，期间被关闭的 fd 不再提交
+// 只跟踪 [0, max_fd) 范围内的 fd，超出范围的 fd 每次都直接调用 epoll_ctl
 class Epoller
 {
 public:
-    explicit Epoller(int max_events = 1024);
+    explicit Epoller(int max_events = 1024, size_t max_fd = 65536);
 
     ~Epoller();
 
     bool AddFd(int fd, uint32_t event);     // 往epoll对象中添加fd，event为监听的事件
     
-    bool ModifyFd(int fd, uint32_t event);  // 修改epoll对象中监听的fd的事件
+    bool ModifyFd(int fd, uint32_t event);  // 修改epoll对象中监听的fd的事件，fd 已被移除时重新加入
+
+    // 推迟到下一次 Wait() 之前再修改，只能由调用 Wait() 的线程调用
+    void DeferModifyFd(int fd, uint32_t event);
+
+    // 即使事件没有变化也重新设置一次，ET 模式下让内核重新检查 fd 是否就绪
+    bool RearmFd(int fd);
     
     bool DeleteFd(int fd);                  // 从epoll对象中移除监听的fd
     
-    int Wait(int timeout_ms = -1);          // 调用epoll_wait() 获取哪些fd对应的事件发生了改变
+    int Wait(int timeout_ms = -1);          // 提交推迟的修改，然后调用epoll_wait() 获取哪些fd对应的事件发生了改变
     
     int GetEventFd(size_t i) const;         // 返回成功监听到的发生变化的客户端对应的fd
     
     uint32_t GetEvents(size_t i) const;     // 返回成功监听到的发生变化的客户端的监听事件
 
+    // 取出并清零实际调用 epoll_ctl 的次数
+    uint64_t TakeCtlCount()
+    {
+        return ctl_count_.exchange(0, std::memory_order_relaxed);
+    }
+
+    // 取出并清零被省去的 epoll_ctl 的次数
+    uint64_t TakeSavedCount()
+    {
+        return saved_count_.exchange(0, std::memory_order_relaxed);
+    }
+
 private:
+    // 一个 fd 在 epoll 中的状态。设置了 EPOLLONESHOT 的 fd 同一时刻只会被一个线程处理，各字段不会被并发修改，
+    // 用原子变量保证事件循环线程和子线程交替访问时能看到对方的修改
+    struct FdState
+    {
+        std::atomic<uint32_t> event{0};         // 当前注册的事件
+        std::atomic<bool> is_registered{false}; // 是否在 epoll 中
+        std::atomic<bool> is_armed{false};      // 设置了 EPOLLONESHOT 时，是否还没有触发过
+        uint32_t pending_event = 0;             // 推迟提交的事件，只由事件循环线程访问
+        bool is_pending = false;
+    };
+
+    FdState *GetState(int fd)
+    {
+        return fd >= 0 && static_cast<size_t>(fd) < max_fd_ ? &states_[fd] : nullptr;
+    }
+
+    // 调用 epoll_ctl 并更新 fd 的状态
+    bool Control(int fd, int op, uint32_t event);
+
+    // 提交 DeferModifyFd 推迟的修改
+    void FlushPending();
+
     int epoll_fd_; // 创建的epoll对象的fd
     
     std::vector<struct epoll_event> events_; // 调用epoll_wait() 传递的数组
+
+    size_t max_fd_;
+
+    std::unique_ptr<FdState[]> states_;     // 以 fd 为下标
+
+    std::vector<int> pending_fds_;          // 有推迟修改的 fd
+
+    std::atomic<uint64_t> ctl_count_;
+
+    std::atomic<uint64_t> saved_count_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,305 @@
+#include "file_cache.h"
+
+FileCache::File::File(char *data, int fd, const struct stat &st) : data(data), fd(fd), size(static_cast<size_t>(st.st_size)), st(st)
+{
+    // 文件被替换时 inode 改变，原地修改时大小或修改时间改变，三者相同就认为内容相同，不需要读取内容计算散列
+    snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"", static_cast<unsigned long long>(st.st_ino),
+             static_cast<unsigned long long>(st.st_size),
+             static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ull + st.st_mtim.tv_nsec);
+    struct tm tm;
+    gmtime_r(&st.st_mtime, &tm);
+    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+FileCache::~FileCache()
+{
+    if (watch_thread_.joinable())
+    {
+        uint64_t one = 1;
+        if (write(stop_fd_, &one, sizeof(one)) == sizeof(one))
+        {
+            watch_thread_.join();
+        }
+        else
+        {
+            watch_thread_.detach();
+        }
+    }
+    if (inotify_fd_ >= 0)
+    {
+        close(inotify_fd_);
+    }
+    if (stop_fd_ >= 0)
+    {
+        close(stop_fd_);
+    }
+}
+
+bool FileCache::Initialization(const std::string &root, size_t capacity, size_t max_file_size)
+{
+    assert(!watch_thread_.joinable());
+    capacity_ = capacity;
+    max_file_size_ = std::min(max_file_size, capacity);
+    if (capacity_ == 0)
+    {
+        return true;
+    }
+    // 没有 inotify 就无法得知文件的变化，不能缓存
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || stop_fd_ < 0)
+    {
+        LOG_ERROR("FileCache: create inotify error, errno: %d, file cache disabled", errno);
+        capacity_ = 0;
+        return false;
+    }
+    // 事件中的路径由目录和文件名拼接而成，目录不带末尾的 '/'，和缓存的键一致
+    std::string dir = root;
+    while (dir.size() > 1 && dir.back() == '/')
+    {
+        dir.pop_back();
+    }
+    AddWatch(dir);
+    if (watch_dir_.empty())
+    {
+        LOG_ERROR("FileCache: watch %s error, file cache disabled", dir.c_str());
+        capacity_ = 0;
+        return false;
+    }
+    watch_thread_ = std::thread(&FileCache::Watch, this);
+    return true;
+}
+
+std::shared_ptr<const FileCache::File> FileCache::Acquire(const char *path, struct stat &st)
+{
+    std::string_view key(path);
+    uint64_t generation = 0;
+    if (capacity_ > 0)
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto entry = index_.find(key);
+        if (entry != index_.end())
+        {
+            ++stats_.hit;
+            lru_.splice(lru_.begin(), lru_, entry->second);
+            st = entry->second->file->st;
+            return entry->second->file;
+        }
+        ++stats_.miss;
+        generation = generation_;
+    }
+    if (stat(path, &st) < 0)
+    {
+        st = {};
+        return nullptr;
+    }
+    // 判断是否为普通文件以及访问权限，S_IROTH 表示其他人能否读
+    if (!S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH))
+    {
+        return nullptr;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    char *data = nullptr;
+    if (sendfile_min_size_ > 0 && static_cast<size_t>(st.st_size) >= sendfile_min_size_)
+    {
+        // 用 sendfile() 发送的文件不映射，fd 随缓存项保留，内容直接从页缓存发出
+        auto file = std::make_shared<const File>(nullptr, fd, st);
+        if (capacity_ > 0)
+        {
+            Insert(key, file, generation);
+        }
+        return file;
+    }
+    if (st.st_size > 0)
+    {
+        void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            close(fd);
+            return nullptr;
+        }
+        data = static_cast<char *>(ptr);
+    }
+    close(fd);
+    auto file = std::make_shared<const File>(data, -1, st);
+    if (capacity_ > 0 && file->size <= max_file_size_)
+    {
+        Insert(key, file, generation);
+    }
+    return file;
+}
+
+void FileCache::Insert(std::string_view path, const std::shared_ptr<const File> &file, uint64_t generation)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    // 另一个线程可能已经加入了同一个文件
+    if (generation != generation_ || index_.count(path))
+    {
+        return;
+    }
+    size_t size = file->data ? file->size : 0;
+    size_t fd_num = file->fd >= 0 ? 1 : 0;
+    while ((size_ + size > capacity_ || fd_num_ + fd_num > MAX_FD_NUM_) && !lru_.empty())
+    {
+        Erase(std::prev(lru_.end()));
+        ++stats_.evicted;
+    }
+    lru_.push_front({std::string(path), file});
+    index_.emplace(lru_.front().path, lru_.begin());
+    size_ += size;
+    fd_num_ += fd_num;
+}
+
+void FileCache::Erase(std::list<Entry>::iterator entry)
+{
+    size_ -= entry->file->data ? entry->file->size : 0;
+    fd_num_ -= entry->file->fd >= 0 ? 1 : 0;
+    index_.erase(entry->path);
+    lru_.erase(entry);
+}
+
+void FileCache::Invalidate(std::string_view path)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    ++generation_;
+    if (path.empty() || path.back() != '/')
+    {
+        auto entry = index_.find(path);
+        if (entry != index_.end())
+        {
+            Erase(entry->second);
+            ++stats_.invalidated;
+        }
+        return;
+    }
+    for (auto entry = lru_.begin(); entry != lru_.end();)
+    {
+        auto next = std::next(entry);
+        if (entry->path.compare(0, path.size(), path) == 0)
+        {
+            Erase(entry);
+            ++stats_.invalidated;
+        }
+        entry = next;
+    }
+}
+
+void FileCache::Clear()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    ++generation_;
+    stats_.invalidated += index_.size();
+    index_.clear();
+    lru_.clear();
+    size_ = 0;
+    fd_num_ = 0;
+}
+
+FileCache::Stats FileCache::GetStats()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    Stats stats = stats_;
+    stats.entry_num = index_.size();
+    stats.size = size_;
+    stats.fd_num = fd_num_;
+    return stats;
+}
+
+void FileCache::AddWatch(const std::string &dir)
+{
+    // 同一个目录（如被移动后）再次监视时返回相同的监视描述符，更新它对应的路径
+    int wd = inotify_add_watch(inotify_fd_, dir.c_str(), WATCH_MASK_ | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        LOG_WARN("FileCache: watch %s error, errno: %d", dir.c_str(), errno);
+        return;
+    }
+    watch_dir_[wd] = dir;
+    DIR *dp = opendir(dir.c_str());
+    if (dp == nullptr)
+    {
+        return;
+    }
+    while (struct dirent *entry = readdir(dp))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        std::string path = dir + "/" + entry->d_name;
+        struct stat st;
+        if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)))
+        {
+            AddWatch(path);
+        }
+    }
+    closedir(dp);
+}
+
+void FileCache::Watch()
+{
+    alignas(struct inotify_event) char buf[4096];
+    struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            LOG_ERROR("FileCache: poll error, errno: %d", errno);
+            break;
+        }
+        if (fds[1].revents)
+        {
+            break;
+        }
+        ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+        for (char *ptr = buf; len > 0 && ptr < buf + len;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // 丢失了事件，无法确定哪些文件变化了
+                LOG_WARN("FileCache: inotify queue overflow, clear the cache");
+                Clear();
+                continue;
+            }
+            auto dir = watch_dir_.find(event->wd);
+            if (dir == watch_dir_.end())
+            {
+                continue;
+            }
+            if (event->mask & IN_IGNORED)
+            {
+                watch_dir_.erase(dir);
+                continue;
+            }
+            if (event->len == 0)
+            {
+                // 被监视的目录本身被删除或移动
+                Invalidate(dir->second + "/");
+                continue;
+            }
+            std::string path = dir->second + "/" + event->name;
+            if (event->mask & IN_ISDIR)
+            {
+                Invalidate(path + "/");
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    AddWatch(path);
+                }
+            }
+            else
+            {
+                Invalidate(path);
+            }
+        }
+    }
+}
@@ -0,0 +1,207 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../log/log.h"
+
+// 静态资源的文件映射缓存，所有连接共享（单例）
+// 以文件的完整路径为键，保存 mmap 得到的映射和文件状态，命中时不需要任何系统调用；映射由引用计数管理，
+// 被淘汰或失效的映射在最后一个引用它的响应发送完毕后才解除，因此 munmap 只在淘汰和文件变化时发生
+// 缓存的文件总大小不超过 capacity，超出时按 LRU 淘汰；后台线程用 inotify 监视资源目录，文件变化时使对应的项失效
+// 开启 sendfile 后，不小于 sendfile_min_size 的文件不映射，只保存打开的 fd，由连接用 sendfile() 发送
+class FileCache
+{
+public:
+    // 一个映射到内存或打开着的普通文件：用 sendfile() 发送的文件只有 fd，其余的只有映射 (fd 为 -1)，空文件不映射 (data 为 nullptr)
+    struct File
+    {
+        // 根据文件状态生成 etag 和 last_modified
+        File(char *data, int fd, const struct stat &st);
+
+        ~File()
+        {
+            if (data)
+            {
+                munmap(data, size);
+            }
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+
+        File(const File &) = delete;
+
+        File &operator=(const File &) = delete;
+
+        // 这个文件的 200 或 304 响应的完整响应头，由第一个用到它的响应生成，之后的响应直接复制；随文件一起失效
+        struct Header
+        {
+            std::once_flag once;
+            std::string data;
+        };
+
+        char *data;
+
+        int fd;
+
+        size_t size;
+
+        struct stat st;
+
+        char etag[64];              // 强验证器，由 inode、大小和修改时间（纳秒）组成，带双引号
+
+        char last_modified[32];     // 修改时间，HTTP-date 格式
+
+        mutable Header header[2][2];    // 下标依次为是否是 304 响应、是否保持连接
+    };
+
+    static FileCache *GetInstance()
+    {
+        static FileCache cache;
+        return &cache;
+    }
+
+    // 监视 root 目录（包括子目录）并开启缓存，capacity 为缓存的文件总大小（字节），超过 max_file_size 的文件不缓存
+    // capacity 为 0 或监视失败时不缓存，每次都重新映射文件
+    bool Initialization(const std::string &root, size_t capacity, size_t max_file_size);
+
+    // 不小于 min_size 的文件改为保存 fd 用 sendfile() 发送，0 表示所有文件都映射；在服务器启动之前调用
+    void SetSendfileMinSize(size_t min_size)
+    {
+        sendfile_min_size_ = min_size;
+    }
+
+    size_t GetSendfileMinSize() const
+    {
+        return sendfile_min_size_;
+    }
+
+    // 返回 path 对应文件的映射，st 保存文件状态；文件不存在时 st 清零
+    // 不是其他人可读的普通文件或映射失败时返回空
+    std::shared_ptr<const File> Acquire(const char *path, struct stat &st);
+
+    // 使 path 对应的项失效，path 以 '/' 结尾时使该目录下所有的项失效
+    void Invalidate(std::string_view path);
+
+    // 清空缓存
+    void Clear();
+
+    bool IsEnabled() const
+    {
+        return capacity_ > 0;
+    }
+
+    size_t GetCapacity() const
+    {
+        return capacity_;
+    }
+
+    size_t GetMaxFileSize() const
+    {
+        return max_file_size_;
+    }
+
+    // 缓存的统计信息
+    struct Stats
+    {
+        uint64_t hit;
+        uint64_t miss;
+        uint64_t invalidated;   // 因文件变化而失效的项数
+        uint64_t evicted;       // 因超出容量而淘汰的项数
+        size_t entry_num;
+        size_t size;            // 缓存的文件总大小
+        size_t fd_num;          // 只保存 fd 的项数
+    };
+
+    Stats GetStats();
+
+    // 监视线程的句柄，没有开启缓存时返回 nullptr
+    std::thread *GetWatchThread()
+    {
+        return watch_thread_.joinable() ? &watch_thread_ : nullptr;
+    }
+
+private:
+    FileCache() : capacity_(0), max_file_size_(0), sendfile_min_size_(0), size_(0), fd_num_(0), generation_(0), stats_(),
+                  inotify_fd_(-1), stop_fd_(-1)
+    {
+    }
+
+    ~FileCache();
+
+    // 缓存中的一项，key 指向 path，链表的结点不会移动，因此可以用 string_view 作为索引的键
+    struct Entry
+    {
+        std::string path;
+        std::shared_ptr<const File> file;
+    };
+
+    // 加入一项并按需淘汰最久没有使用的项；generation 与当前不同表示映射期间有文件变化，不加入，避免缓存旧的内容
+    void Insert(std::string_view path, const std::shared_ptr<const File> &file, uint64_t generation);
+
+    // 删除一项，调用者持有 mtx_
+    void Erase(std::list<Entry>::iterator entry);
+
+    // 监视 dir 及其所有子目录，只在初始化和监视线程中调用
+    void AddWatch(const std::string &dir);
+
+    // 监视线程：读取 inotify 事件，使变化的文件对应的项失效
+    void Watch();
+
+    size_t capacity_;
+
+    size_t max_file_size_;
+
+    size_t sendfile_min_size_;
+
+    size_t size_;                   // 缓存的文件总大小，只保存 fd 的文件不占用内存，不计入
+
+    size_t fd_num_;                 // 只保存 fd 的项数，不超过 MAX_FD_NUM_
+
+    uint64_t generation_;           // 每次有项失效时加一
+
+    Stats stats_;
+
+    std::list<Entry> lru_;          // 最近使用的项在前
+
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+
+    std::mutex mtx_;
+
+    int inotify_fd_;
+
+    int stop_fd_;                   // 通知监视线程退出的 eventfd
+
+    std::unordered_map<int, std::string> watch_dir_;    // inotify 的监视描述符对应的目录，只在监视线程中访问
+
+    std::thread watch_thread_;
+
+    static constexpr size_t MAX_FD_NUM_ = 1024;
+
+    static constexpr uint32_t WATCH_MASK_ = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE
+                                          | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+};
+
+#endif
@@ -3,8 +3,12 @@
 std::atomic<int> HttpConnection::http_connection_numner_;
 std::string HttpConnection::resource_dir_;
 bool HttpConnection::is_ET_mode_;
+std::atomic<bool> HttpConnection::is_draining_(false);
 
-HttpConnection::HttpConnection() : fd_(-1), is_close_(true), iov_num_(0) 
+HttpConnection::HttpConnection() : fd_(-1), is_close_(true), generation_(0), is_idle_(false), is_busy_(false),
+                                   is_close_pending_(false), buffer_node_(-1),
+                                   iov_index_(0), sendfile_index_(0), to_write_bytes_(0), response_num_(0), has_deferred_request_(false), keep_alive_(false),
+                                   request_(arena_), response_(arena_)
 { 
     address_ = { 0 };
 };
@@ -19,13 +23,31 @@ void HttpConnection::Initialization(int fd, const sockaddr_in& addr)
     assert(fd > 0);
     fd_ = fd;
     address_ = addr;
+    ++generation_;
     is_close_ = false;
+    is_idle_ = true;
+    is_busy_ = false;
+    is_close_pending_ = false;
+    keep_alive_ = false;
+    request_.Initialization();
+    arena_.Reset();
     read_buf_.RetrieveAll();
     write_buf_.RetrieveAll();
     http_connection_numner_++;
     LOG_INFO("Client[%d](%s : %d) in, userCount:%d", fd_, GetIP().c_str(), GetPort(), static_cast<int>(http_connection_numner_));
 }
 
+void HttpConnection::PlaceBuffers(int node)
+{
+    if (node < 0 || node == buffer_node_)
+    {
+        return;
+    }
+    read_buf_.Reallocate();
+    write_buf_.Reallocate();
+    buffer_node_ = node;
+}
+
 ssize_t HttpConnection::Read(int &error_num)
 {
     ssize_t len = -1;
@@ -41,36 +63,169 @@ ssize_t HttpConnection::Read(int &error_num)
     return len;
 }
 
-bool HttpConnection::Process() 
+bool HttpConnection::Process(bool inline_only) 
 {
-    request_.Initialization();
-    if (read_buf_.ReadableBytes() <= 0)
+    // 处理新的请求时上一条响应链已经发送完毕
+    assert(to_write_bytes_ == 0);
+    response_num_ = 0;
+    has_deferred_request_ = false;
+    while (response_num_ < MAX_PIPELINE_)
+    {
+        // 上一个请求已经处理完才开始解析新的请求，否则从上次中断的地方继续解析
+        if (request_.IsFinished())
+        {
+            request_.Initialization();
+        }
+        if (read_buf_.ReadableBytes() <= 0)
+        {
+            break;
+        }
+        HttpRequest::ParseResult result = request_.Parse(read_buf_, inline_only);
+        if (result == HttpRequest::DEFER_REQUEST)
+        {
+            // 已经生成的响应先发送，这个请求留给线程池
+            has_deferred_request_ = true;
+            break;
+        }
+        if (result == HttpRequest::ON_REQUEST)
+        {
+            // 请求还不完整，数据和解析状态都保留下来，继续读取
+            break;
+        }
+        if (result == HttpRequest::BAD_REQUEST)
+        {
+            LOG_DEBUG("Client[%d] Request Failed, code: %d", fd_, request_.GetErrorCode());
+            QueueErrorResponse(request_.GetErrorCode(), 0);
+            break;
+        }
+        LOG_DEBUG("Client[%d] Request %.*s Success!", fd_, static_cast<int>(request_.GetPath().size()), request_.GetPath().data());
+        QueueResponse();
+        if (!IsKeepAlive())
+        {
+            // 响应之后就关闭连接，后面的请求不再处理
+            break;
+        }
+    }
+    if (response_num_ == 0)
     {
         return false;
     }
-    else if (request_.Parse(read_buf_))
+    BuildIov();
+    return true;
+}
+
+void HttpConnection::QueueResponse()
+{
+    size_t header_begin = write_buf_.ReadableBytes();
+    keep_alive_ = !is_draining_ && request_.GetIsKeepAlive();
+    response_.Initialization(resource_dir_, request_.GetPath(), keep_alive_, 200);
+    if (request_.GetMethod() == HttpRequest::METHOD_GET || request_.GetMethod() == HttpRequest::METHOD_HEAD)
     {
-        LOG_DEBUG("Client[%d] Request %s Success!", fd_, request_.GetPath().c_str());
-        response_.Initialization(resource_dir_, request_.GetPath(), request_.GetIsKeepAlive(), 200);
+        response_.SetConditions(request_.GetHeader(HttpHeader::IF_NONE_MATCH), request_.GetHeader(HttpHeader::IF_MODIFIED_SINCE));
     }
-    else
+    if (request_.GetMethod() == HttpRequest::METHOD_GET)
     {
-        LOG_DEBUG("Client[%d] Request %s Failed!", fd_, request_.GetPath().c_str());
-        response_.Initialization(resource_dir_, request_.GetPath(), false, 400);
+        response_.SetRange(request_.GetHeader(HttpHeader::RANGE), request_.GetHeader(HttpHeader::IF_RANGE));
     }
     response_.MakeResponse(write_buf_);
-    // 响应头
-    iov_[0].iov_base = write_buf_.GetReadPtr();
-    iov_[0].iov_len = write_buf_.ReadableBytes();
-    iov_num_ = 1;
-    // 请求文件
-    if (response_.GetFileSize() > 0 && response_.GetFileAddr())
+    pending_.push_back({header_begin, write_buf_.ReadableBytes(), nullptr, -1, 0, 0});
+    if (response_.GetFileSize() > 0 && (response_.GetFileAddr() || response_.GetFileFd() >= 0))
     {
-        iov_[1].iov_base = response_.GetFileAddr();
-        iov_[1].iov_len = response_.GetFileSize();
-        iov_num_ = 2;
+        if (request_.GetMethod() == HttpRequest::METHOD_HEAD)
+        {
+            // HEAD 请求只发送响应头
+            response_.UnmapFile();
+        }
+        else
+        {
+            // 文件内容按 response_ 给出的分段发送：整个文件，或者 Range 请求的各个范围，多个范围时每段之前有各自的头部
+            for (const HttpResponse::Part &part : response_.GetParts())
+            {
+                size_t text_begin = write_buf_.ReadableBytes();
+                if (!part.header.empty())
+                {
+                    write_buf_.Append(part.header);
+                }
+                pending_.push_back({text_begin, write_buf_.ReadableBytes(), response_.GetFileAddr(), response_.GetFileFd(),
+                                    static_cast<off_t>(part.offset), part.len});
+            }
+            if (!response_.GetTrailer().empty())
+            {
+                size_t text_begin = write_buf_.ReadableBytes();
+                write_buf_.Append(response_.GetTrailer());
+                pending_.push_back({text_begin, write_buf_.ReadableBytes(), nullptr, -1, 0, 0});
+            }
+            files_.push_back(response_.ReleaseFile());
+        }
     }
-    return true;
+    ++response_num_;
+    // 请求的路径和响应用到的临时数据都不再需要，下一个请求从头使用 arena_
+    arena_.Reset();
+}
+
+void HttpConnection::QueueErrorResponse(int code, int retry_after)
+{
+    // 错误响应发送完毕后关闭连接
+    // 出错后无法确定下一个请求从哪里开始，读缓冲区中剩下的数据一并丢弃
+    keep_alive_ = false;
+    request_.Initialization();
+    read_buf_.RetrieveAll();
+    size_t header_begin = write_buf_.ReadableBytes();
+    response_.Initialization(resource_dir_, "", false, code);
+    response_.MakeErrorResponse(write_buf_, retry_after);
+    pending_.push_back({header_begin, write_buf_.ReadableBytes(), nullptr, -1, 0, 0});
+    ++response_num_;
+    arena_.Reset();
+}
+
+void HttpConnection::BuildIov()
+{
+    char *base = write_buf_.GetReadPtr();
+    for (const PendingSegment &pending : pending_)
+    {
+        // 文本和前一段文本相邻（中间没有文件内容，如前一个响应没有响应体）时合并为一个 iovec
+        size_t text_len = pending.text_end - pending.text_begin;
+        if (text_len > 0 && !iov_.empty() && iov_.back().iov_base
+            && static_cast<char *>(iov_.back().iov_base) + iov_.back().iov_len == base + pending.text_begin)
+        {
+            iov_.back().iov_len += text_len;
+        }
+        else if (text_len > 0)
+        {
+            iov_.push_back({base + pending.text_begin, text_len});
+        }
+        if (pending.file_len > 0 && pending.file_fd >= 0)
+        {
+            iov_.push_back({nullptr, pending.file_len});
+            sendfile_.push_back({pending.file_fd, pending.file_offset});
+        }
+        else if (pending.file_len > 0)
+        {
+            iov_.push_back({pending.file + pending.file_offset, pending.file_len});
+        }
+        to_write_bytes_ += text_len + pending.file_len;
+    }
+    pending_.clear();
+}
+
+void HttpConnection::ClearResponses()
+{
+    files_.clear();
+    pending_.clear();
+    iov_.clear();
+    iov_index_ = 0;
+    sendfile_.clear();
+    sendfile_index_ = 0;
+    to_write_bytes_ = 0;
+    write_buf_.RetrieveAll();
+}
+
+void HttpConnection::MakeErrorResponse(int code, int retry_after)
+{
+    ClearResponses();
+    response_num_ = 0;
+    QueueErrorResponse(code, retry_after);
+    BuildIov();
 }
 
 ssize_t HttpConnection::Write(int &error_num)
@@ -78,44 +233,79 @@ ssize_t HttpConnection::Write(int &error_num)
     ssize_t len = -1;
     do
     {
-        len = writev(fd_, iov_, iov_num_);
+        if (iov_[iov_index_].iov_base)
+        {
+            // 到下一段 sendfile() 的文件内容为止的 iovec 一起发送
+            int num = 1, max_num = std::min(GetIovNum(), IOV_MAX);
+            while (num < max_num && iov_[iov_index_ + num].iov_base)
+            {
+                ++num;
+            }
+            len = writev(fd_, GetIov(), num);
+        }
+        else
+        {
+            // sendfile() 会更新传入的偏移，这里用副本，统一由 Advance() 更新
+            off_t offset = sendfile_[sendfile_index_].offset;
+            len = sendfile(fd_, sendfile_[sendfile_index_].fd, &offset, iov_[iov_index_].iov_len);
+            if (len == 0)
+            {
+                // 文件在发送期间被截短，已经发出的 Content-Length 无法兑现，只能关闭连接
+                errno = EIO;
+            }
+        }
         if (len <= 0)
         {
             error_num = errno;
             break;
         }
-        if (GetToWriteBytes() == 0)
+        Advance(static_cast<size_t>(len));
+    } while (GetToWriteBytes() > 0);
+    return len;   
+}
+
+void HttpConnection::Advance(size_t len)
+{
+    // 跳过已经发送完的 iovec，更新第一个没有发送完的 iovec 的起始位置和大小
+    // 注意 iov_base 是 void *类型的，对无类型指针进行算术运算是不被允许的，因为编译器无法确定运算的单位大小
+    assert(len <= to_write_bytes_);
+    to_write_bytes_ -= len;
+    while (len > 0)
+    {
+        struct iovec &iov = iov_[iov_index_];
+        size_t sent = std::min(len, iov.iov_len);
+        bool is_sendfile = iov.iov_base == nullptr;
+        if (is_sendfile)
         {
-            break; // 传输完成
+            // sendfile() 的文件内容记录文件中的偏移
+            sendfile_[sendfile_index_].offset += static_cast<off_t>(sent);
         }
-        // 第一块内存缓冲区中的数据写完了，清空第一块缓冲区，更新第二块缓冲区的起始位置和大小
-        // 注意 iov_[1].iov_base 是 void *类型的，对无类型指针进行算术运算是不被允许的，因为编译器无法确定运算的单位大小
-        else if (static_cast<size_t>(len) > iov_[0].iov_len)
+        else
         {
-            iov_[1].iov_base = static_cast<char *>(iov_[1].iov_base) + (len - iov_[0].iov_len);
-            iov_[1].iov_len -=  (len - iov_[0].iov_len);
-            if (iov_[0].iov_len)
-            {
-                write_buf_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
+            iov.iov_base = static_cast<char *>(iov.iov_base) + sent;
         }
-        else // 第一块缓冲区中的数据还未写完，仅更新第一块缓冲区的相关信息
+        iov.iov_len -= sent;
+        len -= sent;
+        if (iov.iov_len == 0)
         {
-            iov_[0].iov_base = static_cast<char *>(iov_[0].iov_base) + len;
-            iov_[0].iov_len -= len;
-            write_buf_.Retrieve(len);
+            ++iov_index_;
+            sendfile_index_ += is_sendfile;
         }
-    } while (is_ET_mode_ || GetToWriteBytes() > 0);
-    return len;   
+    }
+    if (to_write_bytes_ == 0)
+    {
+        // 整条响应链发送完毕
+        ClearResponses();
+    }
 }
 
 void HttpConnection::Close() 
 {
     response_.UnmapFile();
-    if(is_close_ == false)
+    ClearResponses();
+    // exchange 保证同一个连接只会被真正关闭一次
+    if(is_close_.exchange(true) == false)
     {
-        is_close_ = true; 
         http_connection_numner_--;
         close(fd_);
         LOG_INFO("Client[%d](%s : %d) quit, UserCount:%d", fd_, GetIP().c_str(), GetPort(), static_cast<int>(http_connection_numner_));
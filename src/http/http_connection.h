@@ -2,10 +2,15 @@
 #define HTTP_CONNECTION_H
 
 #include <string>
+#include <cstring>
 #include <cassert>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/uio.h> // struct iovec
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <climits>
+#include <vector>
 #include <atomic>
 #include "../buffer/buffer.h"
 #include "../log/log.h"
@@ -22,6 +27,8 @@ public:
 
     static bool is_ET_mode_;            // 保存客户的连接是否为 ET 模式
 
+    static std::atomic<bool> is_draining_;  // 服务器是否正在排空连接，此后生成的响应都不再保持连接
+
     HttpConnection();
 
     ~HttpConnection();
@@ -29,21 +36,76 @@ public:
     // 初始化一个连接
     void Initialization(int fd, const struct sockaddr_in &addr);
 
+    // 读写缓冲区不在 NUMA 节点 node 上时，在当前线程（拥有这个连接的事件循环线程）重新分配，
+    // 由 first-touch 策略把物理页放到当前线程所在的节点上；在 Initialization() 之前调用
+    void PlaceBuffers(int node);
+
     // 读请求报文
     ssize_t Read(int &error_num);
 
     // 让 request_ 解析读到的请求报文并让 response_ 生成响应报文，设置内存缓冲区 iovec 的信息
-    bool Process();
+    // 读缓冲区中有多个完整的请求时（pipelining）一次全部处理，响应按顺序排成一条 iovec 链一起发送
+    // inline_only 为 true 时（在事件循环线程中处理）遇到需要交给线程池的请求（POST 登录、注册会访问数据库）就停下，
+    // 由 HasDeferredRequest() 告诉调用者，这个请求的请求行已经解析，交给线程池以 inline_only 为 false 调用时继续
+    // 返回是否生成了响应
+    bool Process(bool inline_only = false);
+
+    // 丢弃未处理的请求，生成状态码为 code 的错误响应（不保持连接），设置内存缓冲区 iovec 的信息
+    void MakeErrorResponse(int code, int retry_after);
 
-    // 将生成的响应报文写回
+    // 将生成的响应报文写回：连续的内存段用 writev 发送，用 sendfile() 发送的文件内容在响应链中的位置单独发送
     ssize_t Write(int &error_num);
 
+    // 响应报文中已有 len 字节被发送出去（由 Write() 或 io_uring 后端的发送完成后调用），更新内存缓冲区 iovec 的信息
+    void Advance(size_t len);
+
+    // io_uring 后端由内核把数据读到接收缓冲区，再由事件循环追加到读缓冲区
+    void AppendReadData(const char *data, size_t len)
+    {
+        read_buf_.Append(data, len);
+    }
+
+    // 读缓冲区中是否还有未处理的请求数据
+    bool HasPendingInput() const
+    {
+        return read_buf_.ReadableBytes() > 0;
+    }
+
+    // 最近一次 Process(true) 是否停在了需要交给线程池的请求上；请求方法由解析器得到，不受请求行之前的空行等影响
+    bool HasDeferredRequest() const
+    {
+        return has_deferred_request_;
+    }
+
+    // 响应链中是否有用 sendfile() 发送的文件内容，整条响应链发送完毕前不变
+    bool HasSendfile() const
+    {
+        return !sendfile_.empty();
+    }
+
+    // 返回响应链中还没有发送完的 iovec；只有 epoll 后端使用 sendfile()，其他后端的响应链中都是内存段
+    const struct iovec *GetIov() const
+    {
+        return iov_.data() + iov_index_;
+    }
+
+    int GetIovNum() const
+    {
+        return static_cast<int>(iov_.size() - iov_index_);
+    }
+
+    // 最近一次生成的响应链中的响应个数
+    int GetResponseNum() const
+    {
+        return response_num_;
+    }
+
     // 关闭连接
     void Close();
 
-    int GetToWriteBytes() const
+    size_t GetToWriteBytes() const
     {
-        return iov_[0].iov_len + iov_[1].iov_len;
+        return to_write_bytes_;
     }
 
     int GetFd() const
@@ -51,6 +113,52 @@ public:
         return fd_;
     }
 
+    // 连接的代数，每次 Initialization() 复用对象时加一，用于识别 fd 被复用后过期的任务和定时器回调
+    uint32_t GetGeneration() const
+    {
+        return generation_;
+    }
+
+    bool IsClose() const
+    {
+        return is_close_;
+    }
+
+    // 连接是否空闲：没有未处理完的请求，也没有待发送的响应，只是在等待下一个请求
+    // 由 I/O 后端维护，只在事件循环线程中读取
+    bool IsIdle() const
+    {
+        return is_idle_;
+    }
+
+    void SetIdle(bool is_idle)
+    {
+        is_idle_ = is_idle;
+    }
+
+    // 连接是否有任务交给了线程池：从任务入队到事件循环处理它的完成项之间，子线程可能正在使用连接，事件循环不能关闭它
+    // 由 I/O 后端维护，只在事件循环线程中读写
+    bool IsBusy() const
+    {
+        return is_busy_;
+    }
+
+    void SetBusy(bool is_busy)
+    {
+        is_busy_ = is_busy;
+    }
+
+    // 连接在交给线程池期间超时或排空到期，需要在完成项处理时关闭
+    bool IsClosePending() const
+    {
+        return is_close_pending_;
+    }
+
+    void SetClosePending()
+    {
+        is_close_pending_ = true;
+    }
+
     int GetPort() const
     {
         return ntohs(address_.sin_port);
@@ -68,10 +176,10 @@ public:
         return address_;
     }
 
-    // 返回请求报文中的 Connection 信息
+    // 响应链发送完毕后是否保持连接：由最后一个响应决定，服务器排空连接期间一律不保持连接
     bool IsKeepAlive() const
     {
-        return request_.GetIsKeepAlive();
+        return !is_draining_ && keep_alive_;
     }
 
 private:
@@ -79,16 +187,77 @@ private:
 
     struct sockaddr_in address_; // 客户端地址
 
-    bool is_close_;     // 当前连接是否关闭
+    std::atomic<bool> is_close_;        // 当前连接是否关闭
+
+    std::atomic<uint32_t> generation_;  // 连接的代数
+
+    std::atomic<bool> is_idle_;         // 连接是否空闲
+
+    bool is_busy_;                      // 是否有任务交给了线程池
+
+    bool is_close_pending_;             // 线程池任务完成后是否关闭连接
+
+    int buffer_node_;                   // 读写缓冲区所在的 NUMA 节点，-1 表示未知（由主线程分配）
 
-    int iov_num_;
+    // 已经生成的响应中的一段：写缓冲区中的一段文本（响应头、多个范围时每段的头部）和之后要发送的文件内容
+    // 文件内容是映射的文件 file 或者 sendfile() 的 fd file_fd 中从 file_offset 开始的 file_len 字节
+    struct PendingSegment
+    {
+        size_t text_begin;
+        size_t text_end;
+        char *file;
+        int file_fd;
+        off_t file_offset;
+        size_t file_len;
+    };
+
+    // 用 sendfile() 发送的文件内容，在 iovec 链中对应一个 iov_base 为空的 iovec，iov_len 为还没有发送的字节数
+    struct SendfileSegment
+    {
+        int fd;
+        off_t offset;       // 下一个要发送的字节在文件中的偏移，因 EAGAIN 中断后从这里继续
+    };
+
+    // 生成一个响应追加到写缓冲区，连接保持对文件映射的引用，直到整条响应链发送完毕
+    void QueueResponse();
+
+    // 生成状态码为 code 的错误响应追加到写缓冲区，之后的请求都不再处理
+    void QueueErrorResponse(int code, int retry_after);
+
+    // 所有响应都生成后，根据响应头在写缓冲区中的最终位置构造 iovec 链
+    void BuildIov();
+
+    // 响应链发送完毕或连接关闭时，清空写缓冲区并释放对文件映射的引用
+    void ClearResponses();
+
+    std::vector<PendingSegment> pending_;   // 本轮生成的响应，写缓冲区在生成期间可能扩容，因此先记录偏移
+
+    std::vector<struct iovec> iov_;         // 响应链：依次是各个响应的响应头和文件内容，相邻的文本合并为一个
 
-    struct iovec iov_[2];
+    size_t iov_index_;                      // 第一个还没有发送完的 iovec
+
+    std::vector<SendfileSegment> sendfile_; // 响应链中用 sendfile() 发送的文件内容，按在响应链中的顺序排列
+
+    size_t sendfile_index_;                 // 第一个还没有发送完的 sendfile() 段
+
+    size_t to_write_bytes_;                 // 响应链中还没有发送的字节数
+
+    int response_num_;                      // 最近一次生成的响应链中的响应个数
+
+    bool has_deferred_request_;             // Process(true) 是否停在了需要交给线程池的请求上
+
+    bool keep_alive_;                       // 响应链中最后一个响应是否保持连接（下一个请求可能已经开始解析，不能再从 request_ 得到）
+
+    std::vector<std::shared_ptr<const FileCache::File>> files_;    // 响应链中引用的文件映射，通常由 FileCache 共享
+
+    static constexpr int MAX_PIPELINE_ = 16;        // 一轮最多处理的请求个数
 
     Buffer read_buf_;   // 读缓冲区
 
     Buffer write_buf_;  // 写缓冲区
 
+    Arena arena_;       // request_ 和 response_ 共用的临时内存，每生成一个响应后回收，需要在它们之前构造
+
     HttpRequest request_;
 
     HttpResponse response_;
@@ -0,0 +1,169 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// 常见的请求头部字段：字段名到编号的查找使用编译期构造的完美哈希
+// 由字段名的长度和首、中、尾三个字符（转成小写）组成 32 位的键，乘以系数后取高 SLOT_BITS_ 位作为槽位
+// 系数在编译期搜索，保证所有已知字段名落在不同的槽位上，查找时只需计算一次哈希并比较一次字段名
+class HttpHeader
+{
+public:
+    enum Field : uint8_t
+    {
+        ACCEPT = 0,
+        ACCEPT_CHARSET,
+        ACCEPT_ENCODING,
+        ACCEPT_LANGUAGE,
+        AUTHORIZATION,
+        CACHE_CONTROL,
+        CONNECTION,
+        CONTENT_ENCODING,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        COOKIE,
+        DATE,
+        EXPECT,
+        FORWARDED,
+        FROM,
+        HOST,
+        IF_MATCH,
+        IF_MODIFIED_SINCE,
+        IF_NONE_MATCH,
+        IF_RANGE,
+        IF_UNMODIFIED_SINCE,
+        KEEP_ALIVE,
+        ORIGIN,
+        PRAGMA,
+        RANGE,
+        REFERER,
+        TE,
+        TRAILER,
+        TRANSFER_ENCODING,
+        UPGRADE,
+        UPGRADE_INSECURE_REQUESTS,
+        USER_AGENT,
+        VIA,
+        X_FORWARDED_FOR,
+        X_REAL_IP,
+        X_REQUESTED_WITH,
+        FIELD_NUM,              // 已知字段的个数
+        UNKNOWN = FIELD_NUM,    // 不在表中的字段
+    };
+
+    // 按编号排列的字段名
+    static constexpr std::string_view NAME[FIELD_NUM] = {
+        "Accept", "Accept-Charset", "Accept-Encoding", "Accept-Language", "Authorization", "Cache-Control",
+        "Connection", "Content-Encoding", "Content-Length", "Content-Type", "Cookie", "Date", "Expect",
+        "Forwarded", "From", "Host", "If-Match", "If-Modified-Since", "If-None-Match", "If-Range",
+        "If-Unmodified-Since", "Keep-Alive", "Origin", "Pragma", "Range", "Referer", "TE", "Trailer",
+        "Transfer-Encoding", "Upgrade", "Upgrade-Insecure-Requests", "User-Agent", "Via", "X-Forwarded-For",
+        "X-Real-IP", "X-Requested-With",
+    };
+
+    // 返回字段名（不区分大小写）对应的编号，不是已知字段时返回 UNKNOWN
+    static Field Lookup(std::string_view name);
+
+    // 不区分大小写地比较两个字符串
+    static constexpr bool EqualIgnoreCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (ToLower(a[i]) != ToLower(b[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static constexpr int SLOT_BITS_ = 7;
+
+    static constexpr char ToLower(char ch)
+    {
+        return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch + ('a' - 'A')) : ch;
+    }
+
+    // 哈希的键，字段名不能为空；只有字母受大小写影响，其余字符 | 0x20 后可能和别的字符相同，由最后的比较排除
+    static constexpr uint32_t Key(std::string_view name)
+    {
+        return static_cast<uint32_t>(name.size())
+            | static_cast<uint32_t>(static_cast<uint8_t>(name[0]) | 0x20) << 8
+            | static_cast<uint32_t>(static_cast<uint8_t>(name[name.size() / 2]) | 0x20) << 16
+            | static_cast<uint32_t>(static_cast<uint8_t>(name.back()) | 0x20) << 24;
+    }
+
+    static constexpr uint32_t Slot(uint32_t key, uint32_t seed)
+    {
+        return (key * seed) >> (32 - SLOT_BITS_);
+    }
+
+    // 搜索使所有已知字段名的槽位都不相同的系数，找不到时返回 0
+    static constexpr uint32_t FindSeed()
+    {
+        for (uint32_t seed = 1; seed < (1u << 17); seed += 2)
+        {
+            bool used[1 << SLOT_BITS_] = {};
+            bool ok = true;
+            for (int i = 0; i < FIELD_NUM && ok; ++i)
+            {
+                uint32_t slot = Slot(Key(NAME[i]), seed);
+                ok = !used[slot];
+                used[slot] = true;
+            }
+            if (ok)
+            {
+                return seed;
+            }
+        }
+        return 0;
+    }
+
+    // 槽位到字段编号的表，空的槽位为 UNKNOWN
+    static constexpr std::array<uint8_t, 1 << SLOT_BITS_> BuildTable(uint32_t seed)
+    {
+        std::array<uint8_t, 1 << SLOT_BITS_> table = {};
+        for (auto &field : table)
+        {
+            field = UNKNOWN;
+        }
+        for (int i = 0; i < FIELD_NUM; ++i)
+        {
+            table[Slot(Key(NAME[i]), seed)] = static_cast<uint8_t>(i);
+        }
+        return table;
+    }
+
+    static const uint32_t SEED_;
+
+    static const std::array<uint8_t, 1 << SLOT_BITS_> TABLE_;
+};
+
+inline constexpr uint32_t HttpHeader::SEED_ = HttpHeader::FindSeed();
+
+inline constexpr std::array<uint8_t, 1 << HttpHeader::SLOT_BITS_> HttpHeader::TABLE_ = HttpHeader::BuildTable(HttpHeader::SEED_);
+
+inline HttpHeader::Field HttpHeader::Lookup(std::string_view name)
+{
+    static_assert(SEED_ != 0, "no perfect hash seed for the known header names");
+    if (name.empty())
+    {
+        return UNKNOWN;
+    }
+    uint8_t field = TABLE_[Slot(Key(name), SEED_)];
+    if (field == UNKNOWN)
+    {
+        return UNKNOWN;
+    }
+    // 客户端通常按表中的大小写发送字段名，先直接比较
+    return NAME[field] == name || EqualIgnoreCase(NAME[field], name) ? static_cast<Field>(field) : UNKNOWN;
+}
+
+#endif
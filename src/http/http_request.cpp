@@ -1,159 +1,571 @@
 #include "http_request.h"
 
-const std::unordered_set<std::string> HttpRequest::DEFAULT_HTML{
-    "/index",
-    "/register",
-    "/login",
-    "/welcome",
-    "/video",
-    "/picture",
+// 请求的路径对应的页面
+static constexpr StringTable::Entry DEFAULT_ROUTE[] = {
+    {"/",           "/index.html"},
+    {"/index",      "/index.html"},
+    {"/register",   "/register.html"},
+    {"/login",      "/login.html"},
+    {"/welcome",    "/welcome.html"},
+    {"/video",      "/video.html"},
+    {"/picture",    "/picture.html"},
 };
 
-const std::unordered_map<std::string, int> HttpRequest::DEFAULT_HTML_TAG{
+static constexpr auto DEFAULT_ROUTE_TABLE = StringTable::Build(DEFAULT_ROUTE);
+
+static_assert(DEFAULT_ROUTE_TABLE.seed != 0, "no perfect hash for the default routes");
+
+StringTable HttpRequest::route_(DEFAULT_ROUTE_TABLE);
+
+const std::unordered_map<std::string_view, int> HttpRequest::DEFAULT_HTML_TAG{
     {"/register.html",  0},
     {"/login.html",     1},
 };
 
+std::map<std::string, HttpRequest::BodyHandlerFactory, std::less<>> HttpRequest::body_handler_factory_;
+
+const char *const HttpRequest::METHOD_NAME[] = {
+    "GET", "HEAD", "POST", "UNKNOWN", "PUT", "DELETE", "OPTIONS", "TRACE", "CONNECT", "PATCH",
+};
+
 void HttpRequest::Initialization()
 {
     parse_status_ = PARSE_REQUEST_LINE;
-    method_ = path_ = version_ = body_ = "";
-    header_.clear();
+    method_ = METHOD_UNKNOWN;
+    version_ = 0;
+    error_code_ = 400;
+    is_keep_alive_ = false;
+    content_length_ = 0;
+    is_chunked_ = false;
+    is_streaming_ = false;
+    chunk_status_ = CHUNK_SIZE;
+    chunk_remain_ = 0;
+    trailer_size_ = 0;
+    body_received_ = 0;
+    raw_pos_ = 0;
+    body_handler_ = nullptr;
+    path_ = std::string_view();
+    scanner_.Reset();
+    base_ = nullptr;
+    target_ = query_ = body_ = {0, 0};
+    known_header_.fill({0, 0});
+    // clear() 保留已分配的容量，之后的请求不必再分配内存
+    other_header_.clear();
     post_.clear();
 }
 
-bool HttpRequest::Parse(Buffer &buf)
+HttpRequest::ParseResult HttpRequest::Parse(Buffer &buf, bool defer_post)
 {
-    const std::vector<char> end_flag{'\r', '\n'};
-    if (buf.ReadableBytes() <= 0)
+    // 请求行之前的空行应当忽略 (RFC 9112 2.2)，例如客户端在上一个请求的请求体之后多发送的 CRLF
+    if (parse_status_ == PARSE_REQUEST_LINE && scanner_.GetScanned() == 0)
     {
-        return false;
+        const char *begin = buf.GetReadPtr();
+        while (begin < buf.GetWritePtr() && (*begin == '\r' || *begin == '\n'))
+        {
+            ++begin;
+        }
+        buf.RetrieveUntil(begin);
+    }
+    // 请求行已经在之前解析过的 POST 请求，继续留给线程池
+    if (defer_post && parse_status_ != PARSE_REQUEST_LINE && method_ == METHOD_POST)
+    {
+        return DEFER_REQUEST;
     }
-    while (buf.ReadableBytes() && parse_status_ != FINISH)
+    // 请求在取走之前一直从读缓冲区的读位置开始，两次调用之间缓冲区可能被移动，但相对读位置的偏移不变
+    base_ = buf.GetReadPtr();
+    const size_t len = buf.ReadableBytes();
+    if (parse_status_ == PARSE_REQUEST_LINE || parse_status_ == PARSE_HEADER)
     {
-        // 调用 search 找第一次出现 "\r\n" 的位置传入 在哪找 以及 查找结果 的范围
-        char *line_end = std::search(buf.GetReadPtr(), buf.GetWritePtr(), end_flag.begin(), end_flag.end());
-        std::string line(buf.GetReadPtr(), line_end);
-        switch (parse_status_)
+        // 从上次中断的位置继续扫描，找出请求行和每个头部的行尾、行内的冒号以及头部结束的空行
+        // 只扫描长度限制以内的数据
+        // 停在请求行之后 (DEFER_REQUEST) 再继续时头部可能已经扫描完毕，不能再扫描之后的请求体
+        HttpScanner::ScanResult result = HttpScanner::SCAN_FINISH;
+        if (!scanner_.IsFinished())
         {
-            case PARSE_REQUEST_LINE:
+            result = scanner_.Scan(base_, base_ + std::min(len, MAX_REQUEST_LINE_ + MAX_HEADER_SIZE_ + 2), MAX_HEADER_NUM_ + 1);
+        }
+        const std::vector<HttpScanner::Line> &lines = scanner_.GetLines();
+        if (parse_status_ == PARSE_REQUEST_LINE)
+        {
+            if (lines.empty())
             {
-                if (!ParseRequestLine(line))
+                if (result == HttpScanner::SCAN_INVALID)
                 {
-                    return false;
+                    return Reject(400);
                 }
-                ParsePath();
-                break;
+                // 请求行还不完整，先检查已收到的长度，避免客户端发送无限长的行占用内存
+                return len > MAX_REQUEST_LINE_ ? Reject(414) : ON_REQUEST;
             }
-            case PARSE_HEADER:
+            // 请求行完整后就检查，有错误的请求不必等到头部全部到达
+            if (!ParseRequestLine(GetLine(0)))
             {
-                ParseHeader(line);
-                if (buf.ReadableBytes() <= 2)
-                {
-                    // 等于2的话表明只剩下一个空行了，没有请求数据
-                    parse_status_ = FINISH;
-                }
-                break;
+                return BAD_REQUEST;
             }
-            case PARSE_CONTENT:
+            parse_status_ = PARSE_HEADER;
+            if (defer_post && method_ == METHOD_POST)
             {
-                ParseContent(line);
-                break;
+                return DEFER_REQUEST;
             }
+        }
+        const size_t header_begin = lines[0].end + 1;
+        switch (result)
+        {
+            case HttpScanner::SCAN_AGAIN:
+                return len - header_begin > MAX_HEADER_SIZE_ ? Reject(431) : ON_REQUEST;
+            case HttpScanner::SCAN_INVALID:
+                return Reject(400);
+            case HttpScanner::SCAN_TOO_MANY_LINES:
+                return Reject(431);
             default:
                 break;
         }
-        if (line_end == buf.GetWritePtr())
+        if (scanner_.GetScanned() - header_begin > MAX_HEADER_SIZE_)
+        {
+            return Reject(431);
+        }
+        // 头部全部到达后才逐行解析，每个头部只解析一次
+        for (size_t i = 1; i < lines.size(); ++i)
+        {
+            size_t colon = lines[i].colon == HttpScanner::NO_COLON ? std::string_view::npos
+                                                                  : lines[i].colon - (lines[i - 1].end + 1);
+            if (!ParseHeader(GetLine(i), colon))
+            {
+                return BAD_REQUEST;
+            }
+        }
+        // 空行表示头部结束，之后是长度由 Content-Length 或分块编码确定的请求体，再之后的数据属于下一个请求
+        if (!FinishHeader())
+        {
+            return BAD_REQUEST;
+        }
+        raw_pos_ = static_cast<uint32_t>(scanner_.GetScanned());
+        body_ = {raw_pos_, 0};
+        parse_status_ = is_chunked_ || content_length_ > 0 ? PARSE_CONTENT : FINISH;
+    }
+    if (parse_status_ == PARSE_CONTENT)
+    {
+        ParseResult result = ParseContent(buf);
+        if (result != GET_REQUEST)
+        {
+            return result;
+        }
+    }
+    buf.Retrieve(raw_pos_);
+    ParsePath();
+    ParsePost();
+    LOG_DEBUG("Request method: %s, path: %.*s, version: 1.%d", GetMethodName(), static_cast<int>(path_.size()), path_.data(), version_);
+    return GET_REQUEST;
+}
+
+std::string_view HttpRequest::GetLine(size_t index) const
+{
+    const std::vector<HttpScanner::Line> &lines = scanner_.GetLines();
+    size_t line_begin = index == 0 ? 0 : lines[index - 1].end + 1;
+    std::string_view line(base_ + line_begin, lines[index].end - line_begin);
+    if (!line.empty() && line.back() == '\r')
+    {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+bool HttpRequest::ParseRequestLine(std::string_view line)
+{
+    if (line.size() > MAX_REQUEST_LINE_)
+    {
+        return SetError(414);
+    }
+    // 请求行的格式为 方法 SP 请求目标 SP HTTP-版本，之间只能有一个空格
+    size_t method_end = line.find(' ');
+    if (method_end == std::string_view::npos || method_end == 0)
+    {
+        return SetError(400);
+    }
+    size_t target_end = line.find(' ', method_end + 1);
+    if (target_end == std::string_view::npos)
+    {
+        return SetError(400);
+    }
+    std::string_view method = line.substr(0, method_end);
+    std::string_view target = line.substr(method_end + 1, target_end - method_end - 1);
+    std::string_view version = line.substr(target_end + 1);
+    if (!std::all_of(method.begin(), method.end(), [](char ch) { return IsTokenChar(ch); }))
+    {
+        return SetError(400);
+    }
+    // 版本的格式为 HTTP/数字.数字，主版本号不是 1 的请求不支持
+    if (version.size() != 8 || version.substr(0, 5) != "HTTP/" || !isdigit(version[5])
+        || version[6] != '.' || !isdigit(version[7]))
+    {
+        return SetError(400);
+    }
+    if (version[5] != '1')
+    {
+        return SetError(505);
+    }
+    version_ = version[7] == '0' ? 0 : 1;
+    // 方法名区分大小写；不认识的方法回复 501，认识但不支持的方法回复 405
+    for (int i = METHOD_GET; i <= METHOD_PATCH; ++i)
+    {
+        if (i != METHOD_UNKNOWN && method == METHOD_NAME[i])
         {
-            break; // 所有数据都读完了
+            method_ = static_cast<Method>(i);
+            break;
         }
-        buf.RetrieveUntil(line_end + 2);
     }
-    LOG_DEBUG("Request method: %s, path: %s, version: %s", method_.c_str(), path_.c_str(), version_.c_str());
+    if (method_ == METHOD_UNKNOWN)
+    {
+        return SetError(501);
+    }
+    if (method_ > METHOD_UNKNOWN)
+    {
+        return SetError(405);
+    }
+    // 请求目标中不能有空白和控制字符
+    if (target.empty() || !std::all_of(target.begin(), target.end(),
+        [](char ch) { return ch > ' ' && ch < 0x7f; }))
+    {
+        return SetError(400);
+    }
+    target_ = ToSlice(target);
+    // 绝对形式 (http://host/path) 的请求目标只取路径部分
+    std::string_view path = target;
+    size_t scheme_end = path.find("://");
+    if (path[0] != '/' && scheme_end != std::string_view::npos
+        && (HttpHeader::EqualIgnoreCase(path.substr(0, scheme_end), "http") || HttpHeader::EqualIgnoreCase(path.substr(0, scheme_end), "https")))
+    {
+        size_t path_begin = path.find('/', scheme_end + 3);
+        path = path_begin == std::string_view::npos ? std::string_view("/") : path.substr(path_begin);
+    }
+    if (path[0] != '/')
+    {
+        return SetError(400);
+    }
+    size_t query_begin = path.find('?');
+    if (query_begin != std::string_view::npos)
+    {
+        query_ = ToSlice(path.substr(query_begin + 1));
+        path = path.substr(0, query_begin);
+    }
+    // 路径直接拼接在资源目录之后，拒绝含有 ".." 路径段的请求，防止访问资源目录之外的文件
+    size_t dots = path.find("/..");
+    while (dots != std::string_view::npos)
+    {
+        if (dots + 3 == path.size() || path[dots + 3] == '/')
+        {
+            return SetError(400);
+        }
+        dots = path.find("/..", dots + 3);
+    }
+    // 读缓冲区在请求不完整时可能被移动，路径复制一份
+    // 复制时合并连续的 '/' 并去掉 "." 路径段，同一个文件只有一种路径，路由表和文件缓存都以路径为键
+    char *normalized = arena_->AllocateChars(path.size());
+    size_t len = 0;
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        if (len > 0 && normalized[len - 1] == '/'
+            && (path[i] == '/' || (path[i] == '.' && (i + 1 == path.size() || path[i + 1] == '/'))))
+        {
+            continue;
+        }
+        normalized[len++] = path[i];
+    }
+    path_ = std::string_view(normalized, len);
     return true;
 }
 
-bool HttpRequest::ParseRequestLine(const std::string &line)
+bool HttpRequest::ParseHeader(std::string_view line, size_t colon)
 {
-    // ^ 和 $ 分别表示字符串的开头结尾，([^ ]*) 表示匹配任意长度的非空格字符串
-    std::regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    std::smatch sub_match;
-    // 匹配成功的话，匹配结果保存在 sub_match 中
-    if (std::regex_match(line, sub_match, patten))
-    {
-        method_ = sub_match[1];
-        path_ = sub_match[2];
-        version_ = sub_match[3];
-        parse_status_ = PARSE_HEADER;
+    // 以空白开头的行是已废弃的折叠行 (obs-fold)，直接拒绝
+    if (line.empty() || line[0] == ' ' || line[0] == '\t')
+    {
+        return SetError(400);
+    }
+    if (colon == std::string_view::npos || colon == 0)
+    {
+        return SetError(400);
+    }
+    // 字段名必须是 token，字段名和冒号之间不能有空白 (RFC 9112 5.1)
+    std::string_view name = line.substr(0, colon);
+    if (!std::all_of(name.begin(), name.end(), [](char ch) { return IsTokenChar(ch); }))
+    {
+        return SetError(400);
+    }
+    // 去掉字段值前后的空白，字段值中的控制字符已经由扫描器检查过
+    std::string_view value = line.substr(colon + 1);
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+    {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+    {
+        value.remove_suffix(1);
+    }
+    // 已知字段的第一次出现保存在按编号索引的数组中，其余的字段按出现顺序保存
+    // 头部字段的个数已经由扫描器限制在 MAX_HEADER_NUM_ 以内
+    HttpHeader::Field field = HttpHeader::Lookup(name);
+    if (field == HttpHeader::UNKNOWN)
+    {
+        other_header_.emplace_back(ToSlice(name), ToSlice(value));
         return true;
     }
-    LOG_ERROR(line.c_str());
-    LOG_ERROR("ParseRequestLine Error!");
-    return false;
+    if (known_header_[field].offset == 0)
+    {
+        known_header_[field] = ToSlice(value);
+        return true;
+    }
+    switch (field)
+    {
+        case HttpHeader::HOST:                  // Host 只能有一个 (RFC 9112 3.2)
+        case HttpHeader::TRANSFER_ENCODING:     // chunked 只能出现一次，其余的编码不支持
+            return SetError(400);
+        case HttpHeader::CONTENT_LENGTH:        // 出现多次时值必须相同
+            if (View(known_header_[field]) != value)
+            {
+                return SetError(400);
+            }
+            return true;
+        default:
+            other_header_.emplace_back(ToSlice(name), ToSlice(value));
+            return true;
+    }
 }
 
-void HttpRequest::ParsePath()
+bool HttpRequest::FinishHeader()
+{
+    // 只支持 chunked 一种传输编码，其余的编码回复 501
+    std::string_view transfer_encoding = GetHeader(HttpHeader::TRANSFER_ENCODING);
+    if (!transfer_encoding.empty() && !HttpHeader::EqualIgnoreCase(transfer_encoding, "chunked"))
+    {
+        return SetError(501);
+    }
+    is_chunked_ = !transfer_encoding.empty();
+    // Content-Length 只能是十进制数字
+    std::string_view length = GetHeader(HttpHeader::CONTENT_LENGTH);
+    bool has_length = known_header_[HttpHeader::CONTENT_LENGTH].offset != 0;
+    if (has_length && (length.empty() || length.size() > 19
+        || !std::all_of(length.begin(), length.end(), [](char ch) { return isdigit(ch); })))
+    {
+        return SetError(400);
+    }
+    for (char ch : length)
+    {
+        content_length_ = content_length_ * 10 + (ch - '0');
+    }
+    // HTTP/1.1 的请求必须有一个 Host 头部 (RFC 9112 3.2)，重复的 Host 在解析头部时已经拒绝
+    if (version_ == 1 && known_header_[HttpHeader::HOST].offset == 0)
+    {
+        return SetError(400);
+    }
+    // 同时带有 Transfer-Encoding 和 Content-Length 的请求可能被用来走私请求，HTTP/1.0 的请求不能使用传输编码 (RFC 9112 6.1, 6.3)
+    if (is_chunked_ && (has_length || version_ == 0))
+    {
+        return SetError(400);
+    }
+    if (method_ == METHOD_POST && (is_chunked_ || content_length_ > 0))
+    {
+        auto factory = body_handler_factory_.find(path_);
+        if (factory != body_handler_factory_.end())
+        {
+            body_handler_ = factory->second(*this);
+        }
+    }
+    // 没有处理函数的请求体要完整地保存在读缓冲区中，限制它的长度；分块编码的请求体在解码时检查
+    if (!body_handler_ && content_length_ > MAX_BODY_SIZE_)
+    {
+        return SetError(413);
+    }
+    // HTTP/1.1 默认保持连接，除非 Connection 中有 close；HTTP/1.0 只有 Connection 中有 keep-alive 时才保持连接
+    std::string_view connection = GetHeader(HttpHeader::CONNECTION);
+    is_keep_alive_ = version_ == 1 ? !HasToken(connection, "close") : HasToken(connection, "keep-alive");
+    return true;
+}
+
+HttpRequest::ParseResult HttpRequest::ParseContent(Buffer &buf)
 {
-    if (path_ == "/")
+    bool finished = false;
+    if (is_chunked_)
     {
-        path_ = "/index.html";
+        if (!ParseChunked(buf, finished))
+        {
+            return BAD_REQUEST;
+        }
     }
     else
     {
-        for (auto &s : DEFAULT_HTML)
+        // 只取 Content-Length 以内的数据，之后的数据属于下一个请求
+        size_t len = std::min(buf.ReadableBytes() - raw_pos_, content_length_ - body_received_);
+        body_.len += len;
+        raw_pos_ += len;
+        body_received_ += len;
+        finished = body_received_ == content_length_;
+    }
+    if (body_handler_)
+    {
+        // 较大的请求体把已经解码的部分交给处理函数，然后连同分块编码的格式从读缓冲区中删除，请求行和头部仍然保留
+        is_streaming_ = is_streaming_ || content_length_ > MAX_BUFFERED_BODY_ || body_.len > MAX_BUFFERED_BODY_;
+        if (is_streaming_ && (body_.len > 0 || finished))
         {
-            if (path_ == s)
+            if (!body_handler_(View(body_), finished))
             {
-                path_ += ".html";
-                break;
+                return Reject(400);
+            }
+            buf.Erase(body_.offset, raw_pos_ - body_.offset);
+            raw_pos_ = body_.offset;
+            body_.len = 0;
+        }
+        else if (finished && !body_handler_(View(body_), true))
+        {
+            return Reject(400);
+        }
+    }
+    if (!finished)
+    {
+        return ON_REQUEST;
+    }
+    parse_status_ = FINISH;
+    return GET_REQUEST;
+}
+
+bool HttpRequest::ParseChunked(Buffer &buf, bool &finished)
+{
+    char *data = buf.GetReadPtr();
+    const size_t len = buf.ReadableBytes();
+    while (raw_pos_ < len && !finished)
+    {
+        if (chunk_status_ == CHUNK_DATA)
+        {
+            // 块数据前移到已解码的请求体之后，解码后的请求体在读缓冲区中是连续的
+            size_t data_len = std::min(len - raw_pos_, chunk_remain_);
+            memmove(data + body_.offset + body_.len, data + raw_pos_, data_len);
+            body_.len += data_len;
+            raw_pos_ += data_len;
+            body_received_ += data_len;
+            chunk_remain_ -= data_len;
+            if (chunk_remain_ == 0)
+            {
+                chunk_status_ = CHUNK_DATA_END;
             }
+            continue;
+        }
+        // 其余的状态都以行为单位，行不完整时等待更多数据，同时限制行的长度
+        const char *line_end = static_cast<const char *>(memchr(data + raw_pos_, '\n', len - raw_pos_));
+        if (!line_end)
+        {
+            return len - raw_pos_ > MAX_CHUNK_LINE_ ? SetError(400) : true;
+        }
+        std::string_view line(data + raw_pos_, line_end - (data + raw_pos_));
+        raw_pos_ += line.size() + 1;
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        if (line.size() > MAX_CHUNK_LINE_)
+        {
+            return SetError(400);
+        }
+        if (!ParseChunkLine(line, finished))
+        {
+            return false;
         }
     }
+    return true;
 }
 
-void HttpRequest::ParseHeader(const std::string &line)
+bool HttpRequest::ParseChunkLine(std::string_view line, bool &finished)
 {
-    // 匹配以 : 为分隔符的请求头部中的字段名和字段值
-    std::regex patten("^([^:]*): ?(.*)$");
-    std::smatch sub_match;
-    if (std::regex_match(line, sub_match, patten))
+    // 分块编码中不能有控制字符
+    if (!std::all_of(line.begin(), line.end(), [](char ch) { return (ch >= ' ' || ch == '\t') && ch != 0x7f; }))
     {
-        header_[sub_match[1]] = sub_match[2];
+        return SetError(400);
     }
-    else // 不匹配说明到最后一行空行了，转换状态
+    switch (chunk_status_)
     {
-        parse_status_ = PARSE_CONTENT;
+        case CHUNK_SIZE:
+        {
+            // 块大小是十六进制数，之后可以有以分号开始的块扩展，块扩展直接忽略
+            size_t size = 0, i = 0;
+            for (; i < line.size() && ConverHex(line[i]) >= 0; ++i)
+            {
+                if (i >= 15)
+                {
+                    return SetError(400);
+                }
+                size = size * 16 + ConverHex(line[i]);
+            }
+            std::string_view extension = line.substr(i);
+            while (!extension.empty() && (extension.front() == ' ' || extension.front() == '\t'))
+            {
+                extension.remove_prefix(1);
+            }
+            if (i == 0 || (!extension.empty() && extension.front() != ';'))
+            {
+                return SetError(400);
+            }
+            if (!body_handler_ && body_received_ + size > MAX_BODY_SIZE_)
+            {
+                return SetError(413);
+            }
+            // 大小为 0 的块是最后一个块，之后是尾部字段
+            chunk_remain_ = size;
+            chunk_status_ = size > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+            return true;
+        }
+        case CHUNK_DATA_END:
+        {
+            if (!line.empty())
+            {
+                return SetError(400);
+            }
+            chunk_status_ = CHUNK_SIZE;
+            return true;
+        }
+        default: // CHUNK_TRAILER
+        {
+            // 空行表示请求结束；尾部字段不影响请求的处理，检查长度后忽略
+            if (line.empty())
+            {
+                finished = true;
+                return true;
+            }
+            trailer_size_ += line.size();
+            return trailer_size_ > MAX_HEADER_SIZE_ ? SetError(431) : true;
+        }
     }
 }
 
-void HttpRequest::ParseContent(const std::string &line)
+void HttpRequest::ParsePath()
 {
-    body_ = line;
-    ParsePost();
-    parse_status_ = FINISH;
-    LOG_DEBUG("ParseContent: %s, len: %d", line.c_str(), line.size());
+    std::string_view page = route_.Find(path_);
+    if (!page.empty())
+    {
+        path_ = page;
+    }
 }
 
 void HttpRequest::ParsePost()
 {
     // 检查请求方法是否为POST，以及请求头部的 Content-Type 是否为 application/x-www-form-urlencoded
     // 如果条件满足，表示接收到的是以URL编码形式提交的表单数据，调用 ParseFromUrlEncoded 解析
-    if (method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded")
+    static constexpr std::string_view FORM_TYPE = "application/x-www-form-urlencoded";
+    std::string_view type = GetHeader(HttpHeader::CONTENT_TYPE);
+    if (method_ == METHOD_POST && HttpHeader::EqualIgnoreCase(type.substr(0, FORM_TYPE.size()), FORM_TYPE))
     {
         ParseFromUrlEncoded();
-        if (DEFAULT_HTML_TAG.count(path_))
+        auto tag = DEFAULT_HTML_TAG.find(path_);
+        if (tag != DEFAULT_HTML_TAG.end())
         {
-            int act = DEFAULT_HTML_TAG.at(path_);
+            std::string_view username = GetPost("username");
             // 根据登录或者注册的结果来决定返回哪个页面
-            if (act == 0) // 用户请求注册
+            if (tag->second == 0) // 用户请求注册
             {
-                LOG_INFO("user: %s requires sign up", post_["username"].c_str());
-                path_ = UserRegister(post_["username"], post_["password"]) ? "/welcome.html" : "/error.html";
+                LOG_INFO("user: %.*s requires sign up", static_cast<int>(username.size()), username.data());
+                path_ = UserRegister(username, GetPost("password")) ? "/welcome.html" : "/error.html";
             }
-            else if (act == 1) // 用户请求登录
+            else if (tag->second == 1) // 用户请求登录
             {
-                LOG_INFO("user: %s requires log in", post_["username"].c_str());
-                path_ = UserVerify(post_["username"], post_["password"]) ? "/welcome.html" : "/error.html";
+                LOG_INFO("user: %.*s requires log in", static_cast<int>(username.size()), username.data());
+                path_ = UserVerify(username, GetPost("password")) ? "/welcome.html" : "/error.html";
             }
         }
     }
@@ -161,71 +573,97 @@ void HttpRequest::ParsePost()
 
 void HttpRequest::ParseFromUrlEncoded()
 {
-    size_t len = body_.size();
-    if (len == 0)
-    {
-        return ;
-    }
-    std::string key, value;
-    size_t num = 0, cur = 0, last = 0;
-    for (; cur < len; ++cur) // 遍历每个字符
+    // 表单数据的格式为 key1=value1&key2=value2，键和值都经过 URL 编码
+    std::string_view body = View(body_);
+    while (!body.empty())
     {
-        switch (body_[cur]) 
+        size_t pair_end = body.find('&');
+        std::string_view pair = body.substr(0, pair_end);
+        body = pair_end == std::string_view::npos ? std::string_view() : body.substr(pair_end + 1);
+        if (pair.empty())
         {
-            case '=': // '=' 表示找到了键的结束位置，更新 last 的值为下一个键值对的起始位置
-            {
-                key = body_.substr(last, cur - last);
-                last = cur + 1;
-                break;
-            }
-            case '+': // '+'，表示遇到了 URL 编码的空格，将其替换为实际空格字符 ' '
-            {
-                body_[cur] = ' ';
-                break;
-            }
-            case '%': // '%'，表示遇到了 URL 编码的特殊字符，需要将其转换为对应的字符
-            {
-                num = ConverHex(body_[cur + 1]) * 16 + ConverHex(body_[cur + 2]);
-                body_[cur + 2] = num % 10 + '0';
-                body_[cur + 1] = num / 10 + '0';
-                cur += 2;
-                break;
-            }
-            case '&': // '&'，则表示找到了一个完整的键值对，将键值对存储到 post_ 哈希表中
-            {
-                value = body_.substr(last, cur - last);
-                last = cur + 1;
-                post_[key] = value;
-                break;
-            }
-            default:
-                break;
+            continue;
+        }
+        size_t key_end = pair.find('=');
+        std::string_view key = DecodeUrl(pair.substr(0, key_end));
+        std::string_view value = key_end == std::string_view::npos ? std::string_view() : DecodeUrl(pair.substr(key_end + 1));
+        // 同一个键出现多次时保留最后一个值
+        auto same_key = std::find_if(post_.begin(), post_.end(), [&](const auto &item) { return item.first == key; });
+        if (same_key != post_.end())
+        {
+            same_key->second = value;
+        }
+        else
+        {
+            post_.emplace_back(key, value);
         }
     }
-    assert(last <= cur);
-    // 保存最后一个键值对
-    if (post_.count(key) == 0 && last < cur)
+}
+
+std::string_view HttpRequest::DecodeUrl(std::string_view str)
+{
+    // 解码后不会变长
+    char *result = arena_->AllocateChars(str.size());
+    size_t len = 0;
+    for (size_t i = 0; i < str.size(); ++i)
     {
-        value = body_.substr(last, cur - last);
-        post_[key] = value;
+        // '+' 表示空格，%XX 表示十六进制编码的字节，不合法的 % 按原样保留
+        if (str[i] == '+')
+        {
+            result[len++] = ' ';
+        }
+        else if (str[i] == '%' && i + 2 < str.size() && ConverHex(str[i + 1]) >= 0 && ConverHex(str[i + 2]) >= 0)
+        {
+            result[len++] = static_cast<char>(ConverHex(str[i + 1]) * 16 + ConverHex(str[i + 2]));
+            i += 2;
+        }
+        else
+        {
+            result[len++] = str[i];
+        }
     }
+    return std::string_view(result, len);
 }
 
 int HttpRequest::ConverHex(char ch)
 {
+    if (ch >= '0' && ch <= '9') return ch - '0';
     if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
     if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
-    return ch;
+    return -1;
 }
 
-bool HttpRequest::UserRegister(const std::string& name, const std::string& pwd)
+bool HttpRequest::HasToken(std::string_view value, std::string_view token)
+{
+    while (!value.empty())
+    {
+        size_t item_end = value.find(',');
+        std::string_view item = value.substr(0, item_end);
+        value = item_end == std::string_view::npos ? std::string_view() : value.substr(item_end + 1);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+        {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+        {
+            item.remove_suffix(1);
+        }
+        if (HttpHeader::EqualIgnoreCase(item, token))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpRequest::UserRegister(std::string_view name, std::string_view pwd)
 {
     if (name.size() == 0 || pwd.size() == 0)
     {
         return false;
     }
-    LOG_INFO("Register name: %s", name.c_str());
-    std::string sql = "SELECT count(*) from user where username = '" + name + "'";
+    LOG_INFO("Register name: %.*s", static_cast<int>(name.size()), name.data());
+    std::string sql = "SELECT count(*) from user where username = '" + std::string(name) + "'";
     std::shared_ptr<MysqlConnection> ptr = MysqlConnectionPool::GetInstance()->GetConnection();
     if (!ptr->Query(sql) || !ptr->Next())
     {
@@ -235,10 +673,10 @@ bool HttpRequest::UserRegister(const std::string& name, const std::string& pwd)
     // 用户名重复，注册失败
     if (ptr->GetValue(0) == "1") 
     {
-        LOG_INFO("User name: %s has been used!", name.c_str());
+        LOG_INFO("User name: %.*s has been used!", static_cast<int>(name.size()), name.data());
         return false;
     }
-    sql = "INSERT INTO user VALUES('" + name + "', '" + pwd +"')";
+    sql = "INSERT INTO user VALUES('" + std::string(name) + "', '" + std::string(pwd) +"')";
     if (!ptr->Update(sql))
     {
         LOG_ERROR("Insert new user error!");
@@ -247,14 +685,14 @@ bool HttpRequest::UserRegister(const std::string& name, const std::string& pwd)
     return true;
 }
 
-bool HttpRequest::UserVerify(const std::string& name, const std::string& pwd)
+bool HttpRequest::UserVerify(std::string_view name, std::string_view pwd)
 {
     if (name.size() == 0 || pwd.size() == 0)
     {
         return false;
     }
-    LOG_INFO("Verify user name: %s, passward: %s", name.c_str(), pwd.c_str());
-    std::string sql = "SELECT username, password from user where username = '" + name + "'";
+    LOG_INFO("Verify user name: %.*s, passward: %.*s", static_cast<int>(name.size()), name.data(), static_cast<int>(pwd.size()), pwd.data());
+    std::string sql = "SELECT username, password from user where username = '" + std::string(name) + "'";
     std::shared_ptr<MysqlConnection> ptr = MysqlConnectionPool::GetInstance()->GetConnection();
     // 查询
     if (!ptr->Query(sql))
@@ -270,35 +708,36 @@ bool HttpRequest::UserVerify(const std::string& name, const std::string& pwd)
             return true;
         }
     }
-    LOG_INFO("User input error password: %s", pwd.c_str());
+    LOG_INFO("User input error password: %.*s", static_cast<int>(pwd.size()), pwd.data());
     return false;
 }
 
-std::string HttpRequest::GetPost(const std::string &key) const
+std::string_view HttpRequest::GetPost(std::string_view key) const
 {
     assert(key.size() > 0);
-    if (post_.count(key))
+    for (auto &item : post_)
     {
-        return post_.at(key);
+        if (item.first == key)
+        {
+            return item.second;
+        }
     }
-    return "";
+    return std::string_view();
 }
 
-std::string HttpRequest::GetPost(const char *key) const
+std::string_view HttpRequest::GetHeader(std::string_view name) const
 {
-    assert(key);
-    if (post_.count(key))
+    HttpHeader::Field field = HttpHeader::Lookup(name);
+    if (field != HttpHeader::UNKNOWN)
     {
-        return post_.at(key);
+        return GetHeader(field);
     }
-    return "";
-}
-
-bool HttpRequest::GetIsKeepAlive() const
-{
-    if (header_.count("Connection"))
+    for (auto &header : other_header_)
     {
-        return header_.at("Connection") == "keep-alive" && version_ == "1.1"; 
+        if (HttpHeader::EqualIgnoreCase(View(header.first), name))
+        {
+            return View(header.second);
+        }
     }
-    return false;
+    return std::string_view();
 }
\ No newline at end of file
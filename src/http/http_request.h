@@ -2,14 +2,30 @@
 #define HTTP_REQUEST_H
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <map>
 #include <unordered_map>
-#include <unordered_set>
-#include <regex>
 #include "../buffer/buffer.h"
+#include "../buffer/arena.h"
 #include "../log/log.h"
+#include "http_scanner.h"
+#include "http_header.h"
+#include "string_table.h"
 #include "../mysql_connection_pool/mysql_connection_pool.h"
 
+// HTTP/1.x 请求报文的解析器
+// 先由 HttpScanner 一次扫描出每一行的位置，请求行和头部字段只保存在读缓冲区中的偏移，解析过程中不分配内存
+// 请求不完整时保留解析状态，收到更多数据后从中断处继续，已经扫描和解析过的部分不会重复处理
+// GetHeader() 返回的 string_view 在下一次向读缓冲区写入数据之前有效，之后还要用到的信息（路径、是否保持连接）在解析时另外保存
+// 请求体按 Content-Length 或分块传输编码 (chunked) 确定长度，分块的请求体在读缓冲区中原地解码，GetBody() 得到连续的请求体
+// 路径注册了请求体处理函数时，较大的请求体边接收边交给处理函数，读缓冲区中只保留请求行、头部和最近收到的数据
+// 路径和表单的键值保存在连接的 Arena 中，连接处理完一个请求后才回收，解析请求不调用全局的分配器
 class HttpRequest
 {
 public:
@@ -22,21 +38,43 @@ public:
         FINISH,                 // 解析完成
     };
 
-    // // 服务器处理HTTP请求的可能结果，报文解析的结果
-    // enum HTTP_STATUS
-    // {
-    //     ON_REQUEST = 0,    // 请求不完整，需要继续读取客户数据
-    //     GET_REQUEST,       // 表示获得了一个完成的客户请求
-    //     SYNTAX_ERROR,      // 表示客户请求语法错误
-    //     NO_RESOURCE,       // 表示服务器没有资源
-    //     FORBIDDEN_ACCESS,  // 表示客户对资源没有足够的访问权限
-    //     GET_FILE,          // 文件请求,获取文件成功
-    //     INTERNAL_ERROR,    // 表示服务器内部错误
-    //     CLOSED_CONNECTION, // 表示客户端已经关闭连接了
-    // };
-
-    HttpRequest()
+    // 解析请求报文的结果
+    enum ParseResult
     {
+        ON_REQUEST = 0, // 请求不完整，需要继续读取客户数据
+        GET_REQUEST,    // 获得了一个完整的客户请求
+        BAD_REQUEST,    // 请求有误，应当回复的状态码由 GetErrorCode() 给出
+        DEFER_REQUEST,  // POST 请求需要交给线程池（可能访问数据库），解析停在请求行之后，之后以 defer_post 为 false 再次调用继续解析
+    };
+
+    // 请求方法，METHOD_UNKNOWN 之后的方法是能识别但服务器不支持的
+    enum Method
+    {
+        METHOD_GET = 0,
+        METHOD_HEAD,
+        METHOD_POST,
+        METHOD_UNKNOWN,
+        METHOD_PUT,
+        METHOD_DELETE,
+        METHOD_OPTIONS,
+        METHOD_TRACE,
+        METHOD_CONNECT,
+        METHOD_PATCH,
+    };
+
+    // 请求体处理函数：data 是依次到达的一段请求体，is_last 为 true 表示请求体结束（此时 data 可能为空）
+    // 返回 false 时放弃这个请求，回复 400
+    using BodyHandler = std::function<bool(std::string_view data, bool is_last)>;
+
+    // 头部解析完毕后为请求创建请求体处理函数，可以根据头部决定如何处理，返回空的函数表示按普通请求处理
+    using BodyHandlerFactory = std::function<BodyHandler(const HttpRequest &request)>;
+
+    // arena 由连接提供，和 HttpResponse 共用，请求处理完之前不能 Reset()
+    explicit HttpRequest(Arena &arena) : arena_(&arena)
+    {
+        // 未知字段和表单键值的存储在连接的生命周期内复用，通常的请求不再分配内存
+        other_header_.reserve(16);
+        post_.reserve(8);
         Initialization();
     }
 
@@ -45,48 +83,136 @@ public:
     void Initialization();
 
     // 采用有限状态机模型解析请求行，请求头部，请求数据
-    bool Parse(Buffer &buf);
+    // 只有得到完整的请求时才从 buf 中取走这个请求；返回 ON_REQUEST 时 buf 保持不变，
+    // 收到更多数据后以同一个 buf 再次调用，从上次中断的状态继续解析
+    // defer_post 为 true 时（在事件循环线程中解析）遇到 POST 请求就返回 DEFER_REQUEST，请求体和表单留给线程池解析
+    ParseResult Parse(Buffer &buf, bool defer_post = false);
 
-    std::string GetPath() const
+    // 是否已经解析完一个请求，下一个请求开始前需要调用 Initialization()
+    bool IsFinished() const
     {
-        return path_;
+        return parse_status_ == FINISH;
     }
 
-    std::string &GetPath()
+    // 返回请求的文件路径，在连接的 Arena 被 Reset() 之前有效
+    std::string_view GetPath() const
     {
         return path_;
     }
 
-    std::string GetMethod()
+    Method GetMethod() const
     {
         return method_;
     }
 
-    std::string GetVersion()
+    const char *GetMethodName() const
+    {
+        return METHOD_NAME[method_];
+    }
+
+    // 返回 HTTP 版本的次版本号，0 表示 HTTP/1.0，1 表示 HTTP/1.1
+    int GetVersion() const
     {
         return version_;
     }
 
-    // 根据解析 POST 请求体的结果返回 value
-    std::string GetPost(const std::string &key) const;
+    // Parse() 返回 BAD_REQUEST 时应当回复的状态码
+    int GetErrorCode() const
+    {
+        return error_code_;
+    }
+
+    // 返回字段名为 name 的头部字段的值（字段名不区分大小写），不存在时返回空；字段出现多次时返回第一个
+    std::string_view GetHeader(std::string_view name) const;
 
-    // 根据解析 POST 请求体的结果返回 value
-    std::string GetPost(const char *key) const;
+    // 返回已知头部字段的值，不需要查找字段名
+    std::string_view GetHeader(HttpHeader::Field field) const
+    {
+        return View(known_header_[field]);
+    }
 
-    // 根据解析得到的请求头部中的信息返回是否持久连接
-    bool GetIsKeepAlive() const;
+    // 返回请求体，有效期和 GetHeader() 相同；请求体已经流式交给处理函数时为空
+    std::string_view GetBody() const
+    {
+        return View(body_);
+    }
+
+    // 为路径 path 的 POST 请求注册请求体处理函数，需要在服务器启动之前调用
+    // 请求体不超过 MAX_BUFFERED_BODY_ 时接收完毕后一次交给处理函数，否则边接收边交给处理函数，长度不受 MAX_BODY_SIZE_ 限制
+    static void RegisterBodyHandler(const std::string &path, BodyHandlerFactory factory)
+    {
+        body_handler_factory_[path] = std::move(factory);
+    }
+
+    // 加入或替换请求路径对应的页面（如 {"/about", "/about.html"}），只能在服务器启动时调用
+    static bool AddRoutes(const std::vector<std::pair<std::string, std::string>> &routes)
+    {
+        return route_.Rebuild(routes);
+    }
+
+    static size_t GetRouteNum()
+    {
+        return route_.Size();
+    }
+
+    // 根据解析 POST 请求体的结果返回 value，不存在时返回空
+    std::string_view GetPost(std::string_view key) const;
+
+    // 根据请求的 HTTP 版本和 Connection 头部返回是否持久连接
+    bool GetIsKeepAlive() const
+    {
+        return is_keep_alive_;
+    }
 
 private:
-    // 解析 Http 请求行内容，包括 方法，URL 和 HTTP版本，它们以空格划分}
-    bool ParseRequestLine(const std::string &line);
+    // 解码分块传输编码的请求体时的状态
+    enum ChunkStatus
+    {
+        CHUNK_SIZE = 0, // 当前正在读取块大小所在的行
+        CHUNK_DATA,     // 当前正在读取块数据
+        CHUNK_DATA_END, // 当前正在读取块数据之后的 CRLF
+        CHUNK_TRAILER,  // 当前正在读取最后一个块之后的尾部字段
+    };
+
+    // 报文中的一段，以相对请求起点（解析时读缓冲区的读位置）的偏移表示，读缓冲区被移动后仍然有效
+    struct Slice
+    {
+        uint32_t offset;
+        uint32_t len;
+    };
+
+    std::string_view View(Slice slice) const
+    {
+        return std::string_view(base_ + slice.offset, slice.len);
+    }
+
+    Slice ToSlice(std::string_view str) const
+    {
+        return {static_cast<uint32_t>(str.data() - base_), static_cast<uint32_t>(str.size())};
+    }
 
-    // 解析请求头部信息，请求头部中每行都以 : 划分字段名和字段值
-    void ParseHeader(const std::string &line);
+    // 返回扫描得到的第 index 行，不含行尾的 CRLF
+    std::string_view GetLine(size_t index) const;
 
-    // 保存请求数据，调用 ParsePost() 解析
-    void ParseContent(const std::string &line);
+    // 解析 Http 请求行内容，包括 方法，URL 和 HTTP版本，它们以一个空格划分
+    bool ParseRequestLine(std::string_view line);
 
-    // 给请求的 path_ 拼接 .html，默认为 /index.html
+    // 解析请求头部信息，请求头部中每行都以 : 划分字段名和字段值，colon 是扫描得到的第一个冒号在行内的位置
+    bool ParseHeader(std::string_view line, size_t colon);
+
+    // 头部解析完毕，检查头部字段并确定请求体的长度
+    bool FinishHeader();
+
+    // 接收请求体：解码新到达的数据，需要时交给请求体处理函数
+    ParseResult ParseContent(Buffer &buf);
+
+    // 解码 buf 中 raw_pos_ 之后的分块，块数据前移接在已解码的请求体之后，读到最后一个块和尾部字段后 finished 为 true
+    bool ParseChunked(Buffer &buf, bool &finished);
+
+    // 处理分块编码中的一行：块大小、块数据之后的空行或尾部字段
+    bool ParseChunkLine(std::string_view line, bool &finished);
+
+    // 把请求的 path_ 换成路由表中对应的页面，例如 / 和 /index 都对应 /index.html
     void ParsePath();
 
     // 解析 POST 请求，修改 path_ 为登录或注册或错误页面
@@ -95,26 +221,102 @@ private:
     // 解析以 URL 编码形式提交的表单数据，保存解析得到的键值对结果
     void ParseFromUrlEncoded();
 
-    // 解析 URL 编码的特殊字符
+    // 解析 URL 编码的特殊字符，结果保存在 arena_ 中
+    std::string_view DecodeUrl(std::string_view str);
+
     static int ConverHex(char ch);
 
+    // 是否为 RFC 9110 中组成 token（方法名、字段名）的字符
+    static bool IsTokenChar(unsigned char ch)
+    {
+        return isalnum(ch) || (ch != '\0' && strchr("!#$%&'*+-.^_`|~", ch) != nullptr);
+    }
+
+    // 以逗号分隔的字段值中是否包含 token（不区分大小写），用于 Connection 头部
+    static bool HasToken(std::string_view value, std::string_view token);
+
+    // 记录错误码，返回 false 方便调用者直接返回
+    bool SetError(int code)
+    {
+        error_code_ = code;
+        return false;
+    }
+
+    ParseResult Reject(int code)
+    {
+        error_code_ = code;
+        return BAD_REQUEST;
+    }
+
     // 用户请求注册信息，连接数据库添加用户的账号，密码
-    bool UserRegister(const std::string& name, const std::string& pwd);
+    bool UserRegister(std::string_view name, std::string_view pwd);
 
     // 连接数据库验证用户的登录信息
-    bool UserVerify(const std::string& name, const std::string& pwd);
+    bool UserVerify(std::string_view name, std::string_view pwd);
 
     ParseStatus parse_status_; // 当前解析请求报文的状态
 
-    std::string method_, path_, version_, body_;                // 保存解析得到的结果
+    Method method_;
+
+    int version_;
+
+    int error_code_;
+
+    bool is_keep_alive_;
+
+    size_t content_length_;
+
+    bool is_chunked_;                       // 请求体是否使用分块传输编码
+
+    bool is_streaming_;                     // 请求体是否边接收边交给处理函数
+
+    ChunkStatus chunk_status_;
+
+    size_t chunk_remain_;                   // 当前块还没有收到的数据长度
+
+    size_t trailer_size_;                   // 已经读取的尾部字段的长度
+
+    size_t body_received_;                  // 已经收到（解码后）的请求体长度，包括已经交给处理函数的部分
+
+    uint32_t raw_pos_;                      // 请求中下一个待处理的字节，请求完成时即为请求在读缓冲区中的长度
+
+    BodyHandler body_handler_;
+
+    HttpScanner scanner_;
+
+    Arena *arena_;
+
+    std::string_view path_;                 // 请求的文件路径，会被 ParsePath() 和 ParsePost() 修改，因此复制到 arena_ 中单独保存
+
+    const char *base_;                      // 本次解析时请求的起点
+
+    Slice target_, query_, body_;           // 请求目标、查询字符串和请求体
+
+    std::array<Slice, HttpHeader::FIELD_NUM> known_header_;    // 已知字段第一次出现时的值，偏移为 0 表示没有这个字段（偏移 0 是请求行）
+
+    std::vector<std::pair<Slice, Slice>> other_header_;         // 按出现顺序保存其余头部字段（未知的字段和重复的已知字段）的字段名和字段值
+
+    std::vector<std::pair<std::string_view, std::string_view>> post_;  // 保存解析 POST 请求体得到的键值对，字符串在 arena_ 中
+
+    static constexpr size_t MAX_REQUEST_LINE_ = 8192;   // 请求行的最大长度，超过时回复 414
+
+    static constexpr size_t MAX_HEADER_SIZE_ = 32768;   // 全部头部字段的最大长度，超过时回复 431
+
+    static constexpr size_t MAX_HEADER_NUM_ = 100;      // 头部字段的最大个数，超过时回复 431
+
+    static constexpr size_t MAX_BODY_SIZE_ = 1 << 20;   // 没有处理函数时请求体的最大长度，超过时回复 413
+
+    static constexpr size_t MAX_BUFFERED_BODY_ = 1 << 16;   // 交给处理函数的请求体超过这个长度时改为边接收边处理
+
+    static constexpr size_t MAX_CHUNK_LINE_ = 4096;     // 分块编码中块大小和尾部字段所在行的最大长度
 
-    std::unordered_map<std::string, std::string> header_;       // 保存请求头部中字段名和字段值的映射
+    static std::map<std::string, BodyHandlerFactory, std::less<>> body_handler_factory_;  // 路径对应的请求体处理函数，可以直接用 string_view 查找
 
-    std::unordered_map<std::string, std::string> post_;         //保存解析 POST 请求体得到的键值对
+    static const char *const METHOD_NAME[];
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;  // 保存所有网页的名字，用于检验请求的网页是否存在
+    static StringTable route_;      // 请求路径到页面的路由表
 
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG; // 方便检查是登录还是注册的 POST 请求
+    static const std::unordered_map<std::string_view, int> DEFAULT_HTML_TAG; // 方便检查是登录还是注册的 POST 请求
 };
 
-#endif
\ No newline at end of file
+#endif
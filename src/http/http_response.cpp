@@ -1,6 +1,7 @@
 #include "http_response.h"
 
-const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE{
+// 文件后缀对应的类型
+static constexpr StringTable::Entry DEFAULT_SUFFIX_TYPE[] = {
     {".html",   "text/html"},
     {".xml",    "text/xml"},
     {".xhtml",  "application/xhtml+xml"},
@@ -22,54 +23,48 @@ const std::unordered_map<std::string, std::string> HttpResponse::SUFFIX_TYPE{
     {".js",     "text/javascript"},
 };
 
-const std::unordered_map<int, std::string> HttpResponse::CODE_DESCRIPTION{
-    {200, "OK"},
-    {400, "Bad Request"},
-    {403, "Forbidden"},
-    {404, "Not Found"},
-};
+static constexpr auto DEFAULT_SUFFIX_TYPE_TABLE = StringTable::Build(DEFAULT_SUFFIX_TYPE);
 
-const std::unordered_map<int, std::string> HttpResponse::CODE_PATH{
-    {400, "/400.html"},
-    {403, "/403.html"},
-    {404, "/404.html"},
-};
+static_assert(DEFAULT_SUFFIX_TYPE_TABLE.seed != 0, "no perfect hash for the default suffix types");
 
-HttpResponse::HttpResponse() : code_(-1), is_keep_alive_(false), path_(""),
-                            resource_dir_(""), mmap_file_(nullptr)
-{
-    mmap_file_stat_ = {0};
-}
+StringTable HttpResponse::suffix_type_(DEFAULT_SUFFIX_TYPE_TABLE);
+
+// 多个范围的 206 响应中分隔各段的边界，资源目录中的文件是服务器自己的，固定的边界不会被利用
+#define RANGE_BOUNDARY "WebServerByteRangesBoundary"
 
-HttpResponse::~HttpResponse()
+HttpResponse::HttpResponse(Arena &arena) : code_(-1), is_keep_alive_(false), file_path_(""), arena_(&arena)
 {
-    UnmapFile();
+    file_stat_ = {0};
+    parts_.reserve(MAX_RANGE_NUM_);
 }
 
-void HttpResponse::Initialization(const std::string &resource_dir, const std::string &path, bool is_keep_alive, int code)
+HttpResponse::~HttpResponse() = default;
+
+void HttpResponse::Initialization(std::string_view resource_dir, std::string_view path, bool is_keep_alive, int code)
 {
     assert(resource_dir.size() > 0);
-    if (mmap_file_) 
-    {
-        UnmapFile();
-    }
+    UnmapFile();
     code_ = code;
     is_keep_alive_ = is_keep_alive;
     path_ = path;
     resource_dir_ = resource_dir;
-    mmap_file_ = nullptr;
-    mmap_file_stat_ = {0};
+    file_path_ = "";
+    file_stat_ = {0};
+    if_none_match_ = if_modified_since_ = range_ = if_range_ = trailer_ = std::string_view();
+    parts_.clear();
 }
 
 void HttpResponse::MakeResponse(Buffer &buf)
 {
-    // 获取请求文件的详细信息，判断是否为目录
-    if (stat((resource_dir_ + path_).c_str(), &mmap_file_stat_) < 0 || S_ISDIR(mmap_file_stat_.st_mode))
+    // 获取请求文件的详细信息和映射，判断是否为目录；文件不存在时 file_stat_ 被清零
+    SetPath(path_);
+    file_ = FileCache::GetInstance()->Acquire(file_path_, file_stat_);
+    if (file_stat_.st_mode == 0 || S_ISDIR(file_stat_.st_mode))
     {
         code_ = 404;
     }
     // 判断访问权限, S_IROTH, S_IWOTH, S_IXOTH 分别表示其他人能否读, 写, 执行
-    else if (!(mmap_file_stat_.st_mode & S_IROTH))
+    else if (!(file_stat_.st_mode & S_IROTH))
     {
         code_ = 403;
     }
@@ -77,29 +72,285 @@ void HttpResponse::MakeResponse(Buffer &buf)
     {
         code_ = 200;
     }
-    FindFile();
+    if (code_ == 200 && file_)
+    {
+        MakeFileResponse(buf);
+    }
+    else
+    {
+        FindFile();
+        AddStatusLine(buf);
+        AddRespondHeader(buf, GetFileType());
+        AddContent(buf);
+    }
+    if (file_ && parts_.empty())
+    {
+        parts_.push_back({std::string_view(), 0, GetFileSize()});
+    }
+}
+
+void HttpResponse::MakeFileResponse(Buffer &buf)
+{
+    bool not_modified = IsNotModified();
+    if (!not_modified && !range_.empty() && MatchIfRange())
+    {
+        RangeResult result = ParseRange(range_, GetFileSize(), parts_);
+        if (result == RANGE_SATISFIABLE)
+        {
+            MakePartialResponse(buf);
+            return;
+        }
+        if (result == RANGE_UNSATISFIABLE)
+        {
+            code_ = 416;
+            AddStatusLine(buf);
+            AddRespondHeader(buf, GetFileType());
+            char line[64];
+            int len = snprintf(line, sizeof(line), "Content-Range: bytes */%zu\r\nContent-length: 0\r\n\r\n", GetFileSize());
+            buf.Append(line, len);
+            UnmapFile();
+            return;
+        }
+    }
+    if (not_modified)
+    {
+        code_ = 304;
+    }
+    // 响应头只取决于文件、状态码和是否保持连接，由第一个响应生成后保存在文件的缓存项中，之后不再格式化
+    FileCache::File::Header &header = file_->header[not_modified][is_keep_alive_];
+    std::call_once(header.once, [this, &header, not_modified] {
+        Buffer tmp(256);
+        AddStatusLine(tmp);
+        AddRespondHeader(tmp, GetFileType());
+        if (!not_modified)
+        {
+            tmp.Append("Accept-Ranges: bytes\r\n");
+        }
+        AddValidators(tmp);
+        AddContent(tmp);
+        header.data = tmp.RetrieveAllToStr();
+    });
+    buf.Append(header.data);
+    if (not_modified)
+    {
+        // 304 响应不发送文件内容
+        UnmapFile();
+    }
+}
+
+void HttpResponse::MakePartialResponse(Buffer &buf)
+{
+    code_ = 206;
     AddStatusLine(buf);
-    AddRespondHeader(buf);
-    AddContent(buf);
+    std::string_view type = GetFileType();
+    size_t size = GetFileSize();
+    char line[96];
+    int len = 0;
+    if (parts_.size() == 1)
+    {
+        AddRespondHeader(buf, type);
+        buf.Append("Accept-Ranges: bytes\r\n");
+        AddValidators(buf);
+        const Part &part = parts_[0];
+        len = snprintf(line, sizeof(line), "Content-Range: bytes %zu-%zu/%zu\r\nContent-length: %zu\r\n\r\n",
+                       part.offset, part.offset + part.len - 1, size, part.len);
+        buf.Append(line, len);
+        return;
+    }
+    AddRespondHeader(buf, "multipart/byteranges; boundary=" RANGE_BOUNDARY);
+    buf.Append("Accept-Ranges: bytes\r\n");
+    AddValidators(buf);
+    // 每段之前是分隔符和这一段的头部，最后是结束分隔符，Content-length 包括它们
+    trailer_ = "\r\n--" RANGE_BOUNDARY "--\r\n";
+    size_t content_len = trailer_.size();
+    for (Part &part : parts_)
+    {
+        static constexpr char FORMAT[] = "\r\n--" RANGE_BOUNDARY "\r\nContent-type: %.*s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n";
+        // 格式串的长度加上三个数的位数就足够容纳替换后的内容
+        size_t header_size = sizeof(FORMAT) + type.size() + 3 * 20;
+        char *header = arena_->AllocateChars(header_size);
+        int header_len = snprintf(header, header_size, FORMAT, static_cast<int>(type.size()), type.data(),
+                                  part.offset, part.offset + part.len - 1, size);
+        part.header = std::string_view(header, header_len);
+        content_len += header_len + part.len;
+    }
+    len = snprintf(line, sizeof(line), "Content-length: %zu\r\n\r\n", content_len);
+    buf.Append(line, len);
+}
+
+HttpResponse::RangeResult HttpResponse::ParseRange(std::string_view range, size_t size, std::vector<Part> &parts)
+{
+    parts.clear();
+    // 范围的单位不区分大小写，只支持 bytes
+    if (range.size() < 6 || strncasecmp(range.data(), "bytes=", 6) != 0)
+    {
+        return RANGE_IGNORED;
+    }
+    range.remove_prefix(6);
+    size_t spec_num = 0;
+    while (!range.empty())
+    {
+        size_t comma = range.find(',');
+        std::string_view spec = TrimSpace(range.substr(0, comma));
+        range.remove_prefix(comma == std::string_view::npos ? range.size() : comma + 1);
+        if (spec.empty())
+        {
+            // 列表中允许空的元素
+            continue;
+        }
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos || ++spec_num > MAX_RANGE_NUM_)
+        {
+            parts.clear();
+            return RANGE_IGNORED;
+        }
+        std::string_view first = spec.substr(0, dash), last = spec.substr(dash + 1);
+        size_t begin = 0, end = 0;
+        if (first.empty())
+        {
+            // -n 表示最后 n 个字节
+            size_t suffix = 0;
+            if (!ParseBytePos(last, suffix))
+            {
+                parts.clear();
+                return RANGE_IGNORED;
+            }
+            if (suffix == 0 || size == 0)
+            {
+                continue;
+            }
+            begin = size - std::min(suffix, size);
+            end = size - 1;
+        }
+        else
+        {
+            // a- 表示从 a 开始到文件末尾，a-b 的 b 超出文件时截断到文件末尾
+            if (!ParseBytePos(first, begin) || (!last.empty() && (!ParseBytePos(last, end) || end < begin)))
+            {
+                parts.clear();
+                return RANGE_IGNORED;
+            }
+            if (begin >= size)
+            {
+                continue;
+            }
+            end = last.empty() ? size - 1 : std::min(end, size - 1);
+        }
+        parts.push_back({std::string_view(), begin, end - begin + 1});
+    }
+    if (parts.empty())
+    {
+        return spec_num > 0 ? RANGE_UNSATISFIABLE : RANGE_IGNORED;
+    }
+    // 按偏移排序并合并重叠或相邻的范围，避免同一段内容被重复发送
+    std::sort(parts.begin(), parts.end(), [](const Part &a, const Part &b) { return a.offset < b.offset; });
+    size_t num = 0;
+    for (size_t i = 1; i < parts.size(); ++i)
+    {
+        Part &prev = parts[num];
+        if (parts[i].offset <= prev.offset + prev.len)
+        {
+            prev.len = std::max(prev.offset + prev.len, parts[i].offset + parts[i].len) - prev.offset;
+        }
+        else
+        {
+            parts[++num] = parts[i];
+        }
+    }
+    parts.resize(num + 1);
+    return RANGE_SATISFIABLE;
+}
+
+bool HttpResponse::MatchIfRange() const
+{
+    if (if_range_.empty())
+    {
+        return true;
+    }
+    // 实体标签使用强比较，弱标签不会匹配
+    if (if_range_.front() == '"' || if_range_.substr(0, 2) == "W/")
+    {
+        return if_range_ == file_->etag;
+    }
+    time_t date;
+    return ParseHttpDate(if_range_, date) && date == file_->st.st_mtime;
+}
+
+void HttpResponse::MakeErrorResponse(Buffer &buf, int retry_after)
+{
+    is_keep_alive_ = false;
+    AddStatusLine(buf);
+    buf.Append("Connection: close\r\n");
+    buf.Append("Content-type: text/html\r\n");
+    if (code_ == 405)
+    {
+        // 405 响应必须用 Allow 头部列出支持的方法
+        buf.Append("Allow: GET, HEAD, POST\r\n");
+    }
+    if (retry_after > 0)
+    {
+        char line[32];
+        int len = snprintf(line, sizeof(line), "Retry-After: %d\r\n", retry_after);
+        buf.Append(line, len);
+    }
+    ErrorContent(buf, code_ == 503 ? "Server is busy now, please retry later." : "");
+}
+
+const HttpResponse::Status *HttpResponse::FindStatus(int code)
+{
+    static_assert([] {
+        for (size_t i = 1; i < std::size(STATUS); ++i)
+        {
+            if (STATUS[i - 1].code >= STATUS[i].code)
+            {
+                return false;
+            }
+        }
+        return true;
+    }(), "STATUS must be sorted by code");
+    const Status *status = std::lower_bound(std::begin(STATUS), std::end(STATUS), code,
+                                            [](const Status &status, int code) { return status.code < code; });
+    return status != std::end(STATUS) && status->code == code ? status : nullptr;
 }
 
 void HttpResponse::FindFile()
 {
-    if (CODE_PATH.count(code_))
+    const Status *status = FindStatus(code_);
+    if (status && !status->page.empty())
+    {
+        SetPath(status->page);
+        file_ = FileCache::GetInstance()->Acquire(file_path_, file_stat_);
+    }
+}
+
+void HttpResponse::SetPath(std::string_view path)
+{
+    path_ = path;
+    // 资源目录以 '/' 结尾，路径以 '/' 开头，拼接时去掉一个，和 FileCache 监视到的文件路径一致
+    if (!resource_dir_.empty() && resource_dir_.back() == '/' && !path.empty() && path[0] == '/')
     {
-        path_ = CODE_PATH.at(code_);
-        stat((resource_dir_ + path_).c_str(), &mmap_file_stat_);
+        path.remove_prefix(1);
     }
+    file_path_ = arena_->Join(resource_dir_, path);
 }
 
 void HttpResponse::AddStatusLine(Buffer &buf)
 {
-    code_ = CODE_DESCRIPTION.count(code_) ? code_ : 400;
-    std::string description = CODE_DESCRIPTION.at(code_);
-    buf.Append("HTTP/1.1 " + std::to_string(code_) + " " + description + "\r\n");
+    // 不认识的状态码按 400 处理
+    const Status *status = FindStatus(code_);
+    if (!status)
+    {
+        code_ = 400;
+        status = FindStatus(code_);
+    }
+    char line[32];
+    int len = snprintf(line, sizeof(line), "HTTP/1.1 %d ", code_);
+    buf.Append(line, len);
+    buf.Append(status->description.data(), status->description.size());
+    buf.Append("\r\n", 2);
 }
 
-void HttpResponse::AddRespondHeader(Buffer &buf)
+void HttpResponse::AddRespondHeader(Buffer &buf, std::string_view type)
 {
     buf.Append("Connection: ");
     if (is_keep_alive_)
@@ -111,62 +362,153 @@ void HttpResponse::AddRespondHeader(Buffer &buf)
     {
         buf.Append("close\r\n");
     }
-    buf.Append("Content-type: " + GetFileType() + "\r\n");
+    if (!HasBody(code_))
+    {
+        return;
+    }
+    buf.Append("Content-type: ");
+    buf.Append(type.data(), type.size());
+    buf.Append("\r\n", 2);
 }
 
 void HttpResponse::AddContent(Buffer &buf)
 {
-    int fd = open((resource_dir_ + path_).c_str(), O_RDONLY);
-    if (fd < 0)
+    if (!HasBody(code_))
     {
-        ErrorContent(buf, "FileNotFound!");
+        buf.Append("\r\n", 2);
         return;
     }
-    // 打印日志
-    // 将文件映射到内存，提高访问速度
-    void *ptr = mmap(nullptr, GetFileSize(), PROT_READ, MAP_PRIVATE, fd, 0);
-    if (ptr == MAP_FAILED)
+    // 文件已经由 FileCache 映射到内存，没有映射表示文件打不开
+    if (!file_)
     {
-        ErrorContent(buf, "FileNotFound");
+        ErrorContent(buf, "FileNotFound!");
         return;
     }
-    mmap_file_ = static_cast<char *>(ptr);
-    close(fd);
-    buf.Append("Content-length: " + std::to_string(GetFileSize()) + "\r\n\r\n");
+    char line[48];
+    int len = snprintf(line, sizeof(line), "Content-length: %zu\r\n\r\n", GetFileSize());
+    buf.Append(line, len);
+}
+
+void HttpResponse::AddValidators(Buffer &buf)
+{
+    buf.Append("ETag: ");
+    buf.Append(file_->etag);
+    buf.Append("\r\nLast-Modified: ");
+    buf.Append(file_->last_modified);
+    buf.Append("\r\n", 2);
 }
 
-void HttpResponse::UnmapFile()
+bool HttpResponse::IsNotModified() const
 {
-    if (mmap_file_)
+    if (!if_none_match_.empty())
     {
-        munmap(mmap_file_, GetFileSize());
-        mmap_file_ = nullptr;
+        return MatchETag(if_none_match_, file_->etag);
     }
+    time_t since;
+    return !if_modified_since_.empty() && ParseHttpDate(if_modified_since_, since) && file_->st.st_mtime <= since;
 }
 
-std::string HttpResponse::GetFileType()
+bool HttpResponse::MatchETag(std::string_view if_none_match, std::string_view etag)
 {
-    // 判断文件类型
-    std::string::size_type idx = path_.find_last_of('.');
-    if (idx != std::string::npos)
+    while (!if_none_match.empty())
     {
-        std::string suffix = path_.substr(idx);
-        if (SUFFIX_TYPE.count(suffix))
+        size_t comma = if_none_match.find(',');
+        std::string_view tag = TrimSpace(if_none_match.substr(0, comma));
+        if_none_match.remove_prefix(comma == std::string_view::npos ? if_none_match.size() : comma + 1);
+        if (tag.substr(0, 2) == "W/")
+        {
+            tag.remove_prefix(2);
+        }
+        if (tag == "*" || tag == etag)
         {
-            return SUFFIX_TYPE.at(suffix);
+            return true;
         }
     }
-    return "text/plain";
+    return false;
+}
+
+std::string_view HttpResponse::TrimSpace(std::string_view str)
+{
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+    {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+    {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+bool HttpResponse::ParseBytePos(std::string_view str, size_t &pos)
+{
+    const char *end = str.data() + str.size();
+    std::from_chars_result result = std::from_chars(str.data(), end, pos);
+    if (result.ptr != end || str.empty())
+    {
+        return false;
+    }
+    if (result.ec == std::errc::result_out_of_range)
+    {
+        pos = SIZE_MAX;
+    }
+    return true;
+}
+
+bool HttpResponse::ParseHttpDate(std::string_view date, time_t &time)
+{
+    // strptime() 需要以 '\0' 结尾的字符串，IMF-fixdate 固定为 29 个字符
+    char str[32];
+    if (date.size() >= sizeof(str))
+    {
+        return false;
+    }
+    memcpy(str, date.data(), date.size());
+    str[date.size()] = '\0';
+    struct tm tm = {};
+    const char *end = strptime(str, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == nullptr || *end != '\0')
+    {
+        return false;
+    }
+    time = timegm(&tm);
+    return true;
+}
+
+std::string_view HttpResponse::GetFileType() const
+{
+    // 判断文件类型
+    size_t idx = path_.find_last_of('.');
+    if (idx == std::string_view::npos)
+    {
+        return "text/plain";
+    }
+    return suffix_type_.Find(path_.substr(idx), "text/plain");
+}
+
+bool HttpResponse::AddSuffixTypes(const std::vector<std::pair<std::string, std::string>> &types)
+{
+    return suffix_type_.Rebuild(types);
+}
+
+size_t HttpResponse::GetSuffixTypeNum()
+{
+    return suffix_type_.Size();
 }
 
-void HttpResponse::ErrorContent(Buffer &buf, const std::string &message)
+void HttpResponse::ErrorContent(Buffer &buf, std::string_view message)
 {
-    std::string body = "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    std::string description = CODE_DESCRIPTION.count(code_) ? CODE_DESCRIPTION.at(code_) : "Bad Request";
-    body += std::to_string(code_) + " : " + description  + "\n";
-    body += "<p>" + message + "</p>";
-    body += "<hr><em>WebServer</em></body></html>";    
-    buf.Append("Content-length: " + std::to_string(body.size()) + "\r\n\r\n");
-    buf.Append(body);
+    static constexpr char FORMAT[] = "<html><title>Error</title><body bgcolor=\"ffffff\">%d : %.*s\n"
+                                     "<p>%.*s</p><hr><em>WebServer</em></body></html>";
+    const Status *status = FindStatus(code_);
+    std::string_view description = status ? status->description : "Bad Request";
+    // 格式串的长度加上状态码的位数就足够容纳替换后的内容
+    size_t size = sizeof(FORMAT) + 16 + description.size() + message.size();
+    char *body = arena_->AllocateChars(size);
+    int body_len = snprintf(body, size, FORMAT, code_, static_cast<int>(description.size()), description.data(),
+                            static_cast<int>(message.size()), message.data());
+    char line[48];
+    int len = snprintf(line, sizeof(line), "Content-length: %d\r\n\r\n", body_len);
+    buf.Append(line, len);
+    buf.Append(body, body_len);
 }
\ No newline at end of file
@@ -1,77 +1,236 @@
 #ifndef HTTP_RESPONSE_H
 #define HTTP_RESPENSE_H
 
-#include <unordered_map>
-#include <fcntl.h>
-#include <unistd.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ctime>
+#include <strings.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
 #include "../buffer/buffer.h"
+#include "../buffer/arena.h"
 #include "../log/log.h"
+#include "string_table.h"
+#include "file_cache.h"
 
+// 生成响应报文；文件的完整路径和错误页面等临时数据放在连接的 Arena 中，生成响应时不调用全局的分配器
+// 文件的映射从 FileCache 取得，缓存命中时不需要 stat、open、mmap 等系统调用；200 和 304 响应的响应头也保存在缓存项中，命中时直接复制
+// 文件的响应带有 ETag 和 Last-Modified，条件请求验证通过时回复 304，不发送文件内容
+// GET 请求带有 Range 时回复 206，只发送请求的范围，多个范围按 multipart/byteranges 格式发送；范围都无法满足时回复 416
 class HttpResponse
 {
 public:
-    HttpResponse();
+    explicit HttpResponse(Arena &arena);
 
     ~HttpResponse();
 
-    void Initialization(const std::string &resource_dir, const std::string &path, bool is_keep_alive = false, int code = -1);
+    // resource_dir 和 path 只保存 string_view，在 MakeResponse() 或 MakeErrorResponse() 返回之前必须有效
+    void Initialization(std::string_view resource_dir, std::string_view path, bool is_keep_alive = false, int code = -1);
+
+    // 设置 GET、HEAD 请求的条件头部 If-None-Match 和 If-Modified-Since，文件没有变化时回复 304
+    // 只保存 string_view，在 MakeResponse() 返回之前必须有效；在 Initialization() 之后调用
+    void SetConditions(std::string_view if_none_match, std::string_view if_modified_since)
+    {
+        if_none_match_ = if_none_match;
+        if_modified_since_ = if_modified_since;
+    }
+
+    // 设置 GET 请求的 Range 和 If-Range 头部，只保存 string_view，要求同 SetConditions()
+    void SetRange(std::string_view range, std::string_view if_range)
+    {
+        range_ = range;
+        if_range_ = if_range;
+    }
+
+    // 响应体中的一段文件内容：文件中从 offset 开始的 len 字节，之前先发送 header（多个范围时每段的头部）
+    struct Part
+    {
+        std::string_view header;
+        size_t offset;
+        size_t len;
+    };
+
+    // MakeResponse() 之后响应体中的各段文件内容，没有 Range 时为整个文件；各段的头部保存在连接的 Arena 中
+    const std::vector<Part> &GetParts() const
+    {
+        return parts_;
+    }
+
+    // 最后一段文件内容之后要发送的数据（multipart 的结束分隔符），只有一段时为空
+    std::string_view GetTrailer() const
+    {
+        return trailer_;
+    }
 
     // 生成响应报文
     void MakeResponse(Buffer &buf);
 
+    // 不读取文件，直接生成状态码为 code_ 的错误响应（如服务器过载时的 503），响应后关闭连接
+    // retry_after > 0 时添加 Retry-After 头部，告诉客户端多少秒后重试
+    void MakeErrorResponse(Buffer &buf, int retry_after = 0);
+
     // 返回请求文件的内存映射得到的地址
     char *GetFileAddr()
     {
-        return mmap_file_;
+        return file_ ? file_->data : nullptr;
+    }
+
+    // 返回用 sendfile() 发送的文件的 fd，文件已经映射时返回 -1
+    int GetFileFd() const
+    {
+        return file_ ? file_->fd : -1;
+    }
+
+    // 不再引用映射的文件，没有其他引用且不在缓存中时解除映射
+    void UnmapFile()
+    {
+        file_.reset();
     }
 
-    void UnmapFile();
+    // 把映射的文件交给调用者，由调用者保持引用直到文件内容发送完毕
+    std::shared_ptr<const FileCache::File> ReleaseFile()
+    {
+        return std::move(file_);
+    }
 
-    
     size_t GetFileSize() const
     {
-        return mmap_file_stat_.st_size;
+        return file_ ? file_->size : 0;
     }
 
     // 生成错误信息的网页
-    void ErrorContent(Buffer &buf, const std::string &message);
+    void ErrorContent(Buffer &buf, std::string_view message);
 
     int GetCode() const
     {
         return code_;
     }
 
+    // 加入或替换文件后缀对应的类型（如 {".webp", "image/webp"}），只能在服务器启动时调用
+    static bool AddSuffixTypes(const std::vector<std::pair<std::string, std::string>> &types);
+
+    static size_t GetSuffixTypeNum();
+
 
 private:
     void AddStatusLine(Buffer &buf);
 
-    void AddRespondHeader(Buffer &buf);
+    // 添加 Connection 和 Content-type 头部，type 为响应体的类型
+    void AddRespondHeader(Buffer &buf, std::string_view type);
 
     void AddContent(Buffer &buf);
 
-    // 根据路径找到文件并获取文件状态信息
+    // 添加文件的验证器 ETag 和 Last-Modified
+    void AddValidators(Buffer &buf);
+
+    // 请求文件存在且可读时生成 200、206、304 或 416 响应
+    void MakeFileResponse(Buffer &buf);
+
+    // 按 parts_ 中的范围生成 206 响应的响应头，多个范围时生成每段的头部和结束分隔符
+    void MakePartialResponse(Buffer &buf);
+
+    // Range 头部的解析结果
+    enum RangeResult
+    {
+        RANGE_IGNORED = 0,      // 格式有误或范围过多，忽略 Range 发送整个文件
+        RANGE_SATISFIABLE,      // 至少有一个范围可以满足
+        RANGE_UNSATISFIABLE,    // 所有范围都超出了文件，回复 416
+    };
+
+    // 解析 Range 头部（如 bytes=0-499, -500, 9500-），可以满足的范围按偏移排序并合并重叠和相邻的范围后保存在 parts 中
+    static RangeResult ParseRange(std::string_view range, size_t size, std::vector<Part> &parts);
+
+    // 没有 If-Range 或者它和文件的 ETag（强比较）、Last-Modified 相同时 Range 才有效
+    bool MatchIfRange() const;
+
+    // 根据条件头部判断客户端缓存的文件是否仍然有效：有 If-None-Match 时只比较 ETag，否则比较 If-Modified-Since 和修改时间
+    bool IsNotModified() const;
+
+    // If-None-Match 的值是否为 * 或者包含和 etag 相同的实体标签（弱比较，忽略 W/ 前缀）
+    static bool MatchETag(std::string_view if_none_match, std::string_view etag);
+
+    // 去掉逗号分隔的列表元素两端的空白 (OWS)
+    static std::string_view TrimSpace(std::string_view str);
+
+    // 解析 Range 中的字节位置（只能是数字），超出 size_t 的数按 SIZE_MAX 处理：起始位置不可满足，结束位置截断到文件末尾，后缀长度表示整个文件
+    static bool ParseBytePos(std::string_view str, size_t &pos);
+
+    // 解析 HTTP-date（IMF-fixdate 格式，如 Sun, 06 Nov 1994 08:49:37 GMT），格式有误时返回 false
+    static bool ParseHttpDate(std::string_view date, time_t &time);
+
+    // 状态码为 1xx、204 和 304 的响应没有响应体
+    static bool HasBody(int code)
+    {
+        return code >= 200 && code != 204 && code != 304;
+    }
+
+    // 状态码有对应的页面时改为回复该页面，获取页面的映射和文件状态信息
     void FindFile();
 
+    // 设置 path_ 和拼接了资源目录的 file_path_
+    void SetPath(std::string_view path);
+
     // 根据请求文件的后缀返回文件类型
-    std::string GetFileType();
+    std::string_view GetFileType() const;
+
+    // 状态码的描述和出错时返回的页面
+    struct Status
+    {
+        int code;
+        std::string_view description;
+        std::string_view page;
+    };
+
+    // 查找状态码，不认识的状态码返回 nullptr
+    static const Status *FindStatus(int code);
 
     int code_;
 
     bool is_keep_alive_;
 
-    std::string path_, resource_dir_;
+    std::string_view path_, resource_dir_;
+
+    std::string_view if_none_match_, if_modified_since_;
+
+    std::string_view range_, if_range_;
+
+    std::vector<Part> parts_;
+
+    std::string_view trailer_;
+
+    const char *file_path_;     // resource_dir_ + path_，保存在 arena_ 中
+
+    Arena *arena_;
 
-    char *mmap_file_; // 保存请求文件内存映射的地址
+    std::shared_ptr<const FileCache::File> file_;   // 请求文件的映射
 
-    struct stat mmap_file_stat_;
+    struct stat file_stat_;
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  // 保存请求文件对应的后缀描述信息
+    static constexpr size_t MAX_RANGE_NUM_ = 16;    // Range 中范围的最大个数，超过时忽略 Range
 
-    static const std::unordered_map<int, std::string> CODE_DESCRIPTION;     // 保存状态码对应的描述
+    static StringTable suffix_type_;        // 保存请求文件对应的后缀描述信息
 
-    static const std::unordered_map<int, std::string> CODE_PATH;            // 保存状态码对应的文件
+    static constexpr Status STATUS[] = {    // 按状态码排序
+        {200, "OK",                                 ""},
+        {204, "No Content",                         ""},
+        {206, "Partial Content",                    ""},
+        {304, "Not Modified",                       ""},
+        {400, "Bad Request",                        "/400.html"},
+        {403, "Forbidden",                          "/403.html"},
+        {404, "Not Found",                          "/404.html"},
+        {405, "Method Not Allowed",                 ""},
+        {413, "Payload Too Large",                  ""},
+        {414, "URI Too Long",                       ""},
+        {416, "Range Not Satisfiable",              ""},
+        {431, "Request Header Fields Too Large",    ""},
+        {501, "Not Implemented",                    ""},
+        {503, "Service Unavailable",                ""},
+        {505, "HTTP Version Not Supported",         ""},
+    };
 
 };
 
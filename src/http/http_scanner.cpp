@@ -0,0 +1,182 @@
+#include "http_scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCANNER_X86
+#endif
+
+const HttpScanner::ScanFunc HttpScanner::SCAN_IMPL = HttpScanner::SelectImpl();
+
+HttpScanner::ScanFunc HttpScanner::SelectImpl()
+{
+#ifdef HTTP_SCANNER_X86
+    // 在静态初始化期间调用，先初始化 CPU 信息
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &HttpScanner::ScanAvx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return &HttpScanner::ScanSse2;
+    }
+#endif
+    return &HttpScanner::ScanScalar;
+}
+
+const char *HttpScanner::GetImplName()
+{
+    if (SCAN_IMPL == &HttpScanner::ScanAvx2)
+    {
+        return "avx2";
+    }
+    return SCAN_IMPL == &HttpScanner::ScanSse2 ? "sse2" : "scalar";
+}
+
+HttpScanner::ScanResult HttpScanner::Scan(const char *begin, const char *end, size_t max_lines)
+{
+    return (this->*SCAN_IMPL)(begin, end, max_lines);
+}
+
+bool HttpScanner::OnSpecial(const char *begin, const char *end, uint32_t pos, size_t max_lines)
+{
+    switch (begin[pos])
+    {
+        case ':':
+        {
+            if (colon_ == NO_COLON)
+            {
+                colon_ = pos;
+            }
+            return true;
+        }
+        case '\r':
+        {
+            // CR 只能出现在 LF 之前；CR 是最后一个字节时等收到下一个字节再判断
+            if (begin + pos + 1 == end)
+            {
+                scanned_ = pos;
+                result_ = SCAN_AGAIN;
+                return false;
+            }
+            if (begin[pos + 1] == '\n')
+            {
+                return true;
+            }
+            result_ = SCAN_INVALID;
+            return false;
+        }
+        case '\n':
+        {
+            // 请求行之后的空行 (CRLF 或单独的 LF) 表示头部结束
+            bool is_empty = pos == line_start_ || (pos == line_start_ + 1 && begin[line_start_] == '\r');
+            if (is_empty && !lines_.empty())
+            {
+                scanned_ = pos + 1;
+                result_ = SCAN_FINISH;
+                return false;
+            }
+            if (lines_.size() >= max_lines)
+            {
+                result_ = SCAN_TOO_MANY_LINES;
+                return false;
+            }
+            lines_.push_back({pos, colon_});
+            line_start_ = pos + 1;
+            colon_ = NO_COLON;
+            return true;
+        }
+        default: // 其余的控制字符
+        {
+            result_ = SCAN_INVALID;
+            return false;
+        }
+    }
+}
+
+HttpScanner::ScanResult HttpScanner::ScanScalar(const char *begin, const char *end, size_t max_lines)
+{
+    const size_t len = end - begin;
+    for (; scanned_ < len; ++scanned_)
+    {
+        if (IsSpecial(begin[scanned_]) && !OnSpecial(begin, end, scanned_, max_lines))
+        {
+            return result_;
+        }
+    }
+    return SCAN_AGAIN;
+}
+
+#ifdef HTTP_SCANNER_X86
+
+// 在一组字节中标记出 IsSpecial() 为真的字节：
+// 无符号的 min(x, 0x1f) == x 即 x <= 0x1f，去掉 HTAB 后再加上冒号和 DEL
+__attribute__((target("sse2")))
+HttpScanner::ScanResult HttpScanner::ScanSse2(const char *begin, const char *end, size_t max_lines)
+{
+    const size_t len = end - begin;
+    const __m128i max_ctl = _mm_set1_epi8(0x1f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    while (len - scanned_ >= 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin + scanned_));
+        __m128i ctl = _mm_andnot_si128(_mm_cmpeq_epi8(x, tab), _mm_cmpeq_epi8(_mm_min_epu8(x, max_ctl), x));
+        __m128i special = _mm_or_si128(ctl, _mm_or_si128(_mm_cmpeq_epi8(x, colon), _mm_cmpeq_epi8(x, del)));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+        while (mask)
+        {
+            uint32_t pos = static_cast<uint32_t>(scanned_) + __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (!OnSpecial(begin, end, pos, max_lines))
+            {
+                return result_;
+            }
+        }
+        scanned_ += 16;
+    }
+    return ScanScalar(begin, end, max_lines);
+}
+
+__attribute__((target("avx2")))
+HttpScanner::ScanResult HttpScanner::ScanAvx2(const char *begin, const char *end, size_t max_lines)
+{
+    const size_t len = end - begin;
+    const __m256i max_ctl = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    while (len - scanned_ >= 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin + scanned_));
+        __m256i ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(x, tab), _mm256_cmpeq_epi8(_mm256_min_epu8(x, max_ctl), x));
+        __m256i special = _mm256_or_si256(ctl, _mm256_or_si256(_mm256_cmpeq_epi8(x, colon), _mm256_cmpeq_epi8(x, del)));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+        while (mask)
+        {
+            uint32_t pos = static_cast<uint32_t>(scanned_) + __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (!OnSpecial(begin, end, pos, max_lines))
+            {
+                return result_;
+            }
+        }
+        scanned_ += 32;
+    }
+    return ScanSse2(begin, end, max_lines);
+}
+
+#else
+
+HttpScanner::ScanResult HttpScanner::ScanSse2(const char *begin, const char *end, size_t max_lines)
+{
+    return ScanScalar(begin, end, max_lines);
+}
+
+HttpScanner::ScanResult HttpScanner::ScanAvx2(const char *begin, const char *end, size_t max_lines)
+{
+    return ScanScalar(begin, end, max_lines);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef HTTP_SCANNER_H
+#define HTTP_SCANNER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 请求行和头部的分隔符扫描器
+// 一次扫描找出每一行的结束位置 (LF)、行内第一个冒号和头部结束的空行，同时检查非法的控制字符
+// 按 16 (SSE2) 或 32 (AVX2) 字节一组比较，得到分隔符的位掩码后只逐个处理分隔符所在的位置
+// 运行时根据 CPU 支持的指令集选择实现，不支持 SIMD 的平台逐字节扫描
+class HttpScanner
+{
+public:
+    // 扫描的结果
+    enum ScanResult
+    {
+        SCAN_AGAIN = 0,     // 数据不完整，还没有找到头部结束的空行
+        SCAN_FINISH,        // 找到了头部结束的空行
+        SCAN_INVALID,       // 出现了非法的控制字符或单独的 CR
+        SCAN_TOO_MANY_LINES,// 行数超过了上限
+    };
+
+    // 一行的信息，位置都是相对扫描起点的偏移
+    struct Line
+    {
+        uint32_t end;       // 行尾 LF 的位置（不含行尾的 CR）
+        uint32_t colon;     // 行内第一个冒号的位置，没有冒号时为 NO_COLON
+    };
+
+    static constexpr uint32_t NO_COLON = UINT32_MAX;
+
+    HttpScanner()
+    {
+        Reset();
+    }
+
+    // 开始扫描一个新的请求
+    void Reset()
+    {
+        scanned_ = 0;
+        line_start_ = 0;
+        colon_ = NO_COLON;
+        result_ = SCAN_AGAIN;
+        lines_.clear();
+    }
+
+    // 是否已经找到了头部结束的空行，此后不需要再扫描
+    bool IsFinished() const
+    {
+        return result_ == SCAN_FINISH;
+    }
+
+    // 扫描 [begin, end)，最多记录 max_lines 行（不含结束的空行）
+    // 返回 SCAN_AGAIN 时可以在收到更多数据后以同一个起点再次调用，已经扫描过的部分不会重复扫描
+    ScanResult Scan(const char *begin, const char *end, size_t max_lines);
+
+    const std::vector<Line> &GetLines() const
+    {
+        return lines_;
+    }
+
+    // 已经扫描过的字节数，返回 SCAN_FINISH 时即为请求行和头部（包括结束的空行）的长度
+    size_t GetScanned() const
+    {
+        return scanned_;
+    }
+
+    // 返回运行时选择的实现的名字
+    static const char *GetImplName();
+
+private:
+    ScanResult ScanScalar(const char *begin, const char *end, size_t max_lines);
+
+    ScanResult ScanSse2(const char *begin, const char *end, size_t max_lines);
+
+    ScanResult ScanAvx2(const char *begin, const char *end, size_t max_lines);
+
+    // 处理位于 pos 的分隔符或控制字符，返回 false 时停止扫描，扫描结果保存在 result_ 中
+    bool OnSpecial(const char *begin, const char *end, uint32_t pos, size_t max_lines);
+
+    // 需要处理的字符：LF、CR、冒号以及除 HTAB 之外的控制字符
+    static bool IsSpecial(unsigned char ch)
+    {
+        return (ch < 0x20 && ch != '\t') || ch == ':' || ch == 0x7f;
+    }
+
+    using ScanFunc = ScanResult (HttpScanner::*)(const char *, const char *, size_t);
+
+    static ScanFunc SelectImpl();
+
+    size_t scanned_;        // 已经扫描过的字节数
+
+    uint32_t line_start_;   // 当前行的起始位置
+
+    uint32_t colon_;        // 当前行内第一个冒号的位置
+
+    ScanResult result_;
+
+    std::vector<Line> lines_;
+
+    static const ScanFunc SCAN_IMPL;    // 启动时选择的实现
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "string_table.h"
+
+bool StringTable::Rebuild(const std::vector<std::pair<std::string, std::string>> &entries)
+{
+    // 先在当前的项上合并，全部成功后再替换，失败时表保持不变
+    std::vector<Entry> merged(entries_, entries_ + size_);
+    size_t string_num = strings_.size();
+    for (auto &entry : entries)
+    {
+        strings_.push_back(entry.second);
+        std::string_view value = strings_.back();
+        auto same_key = std::find_if(merged.begin(), merged.end(), [&](const Entry &old) { return old.key == entry.first; });
+        if (same_key != merged.end())
+        {
+            same_key->value = value;
+            continue;
+        }
+        strings_.push_back(entry.first);
+        merged.push_back({strings_.back(), value});
+    }
+    uint32_t seed = merged.size() <= MAX_SIZE_ ? FindSeed(merged.data(), merged.size(), merged.size() * merged.size()) : 0;
+    if (seed == 0)
+    {
+        strings_.resize(string_num);
+        return false;
+    }
+    std::vector<uint16_t> slots(std::max<size_t>(merged.size() * merged.size(), 1), 0);
+    for (size_t i = 0; i < merged.size(); ++i)
+    {
+        slots[Slot(merged[i].key, seed, slots.size())] = static_cast<uint16_t>(i + 1);
+    }
+    own_entries_.swap(merged);
+    own_slots_.swap(slots);
+    entries_ = own_entries_.data();
+    size_ = own_entries_.size();
+    slots_ = own_slots_.data();
+    slot_num_ = own_slots_.size();
+    seed_ = seed;
+    return true;
+}
@@ -0,0 +1,135 @@
+#ifndef STRING_TABLE_H
+#define STRING_TABLE_H
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// 只读的字符串查找表（键区分大小写），用完美哈希实现，查找时只计算一次哈希、比较一次键，不分配内存
+// 默认内容由 Build() 在编译期构造；启动时可以用 Rebuild() 加入配置中的项重新构造，之后只读，多个线程可以同时查找
+// 槽位数取项数的平方，随机的哈希函数没有冲突的概率约为 1/2，构造时搜索使所有键落在不同槽位上的种子
+class StringTable
+{
+public:
+    struct Entry
+    {
+        std::string_view key;
+        std::string_view value;
+    };
+
+    // 编译期构造的表，槽位中保存项的下标 + 1，0 表示空槽位；seed 为 0 表示构造失败
+    template <size_t N>
+    struct Data
+    {
+        std::array<Entry, N> entries;
+        std::array<uint16_t, N * N> slots;
+        uint32_t seed;
+    };
+
+    // 由 entries 构造表，键不能重复
+    template <size_t N>
+    static constexpr Data<N> Build(const Entry (&entries)[N])
+    {
+        Data<N> data = {};
+        for (size_t i = 0; i < N; ++i)
+        {
+            data.entries[i] = entries[i];
+        }
+        data.seed = FindSeed(entries, N, N * N);
+        for (size_t i = 0; i < N && data.seed != 0; ++i)
+        {
+            data.slots[Slot(entries[i].key, data.seed, N * N)] = static_cast<uint16_t>(i + 1);
+        }
+        return data;
+    }
+
+    // 使用编译期构造的表，data 必须是静态存储期的
+    template <size_t N>
+    explicit StringTable(const Data<N> &data) :
+            entries_(data.entries.data()), size_(N), slots_(data.slots.data()), slot_num_(N * N), seed_(data.seed)
+    {
+    }
+
+    StringTable(const StringTable &) = delete;
+
+    StringTable &operator=(const StringTable &) = delete;
+
+    // 返回 key 对应的值，不存在时返回 default_value
+    std::string_view Find(std::string_view key, std::string_view default_value = std::string_view()) const
+    {
+        uint16_t index = slots_[Slot(key, seed_, slot_num_)];
+        return index > 0 && entries_[index - 1].key == key ? entries_[index - 1].value : default_value;
+    }
+
+    // 加入 entries 中的项（键已经存在时替换它的值）后重新构造，只能在查找开始之前调用
+    // 项数超过 MAX_SIZE_ 或找不到完美哈希时返回 false，表保持不变
+    bool Rebuild(const std::vector<std::pair<std::string, std::string>> &entries);
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+private:
+    // FNV-1a 之后再混合一次，用高位把哈希值映射到 [0, slot_num)
+    static constexpr uint32_t Slot(std::string_view key, uint32_t seed, size_t slot_num)
+    {
+        uint32_t hash = 2166136261u ^ seed;
+        for (char ch : key)
+        {
+            hash = (hash ^ static_cast<uint8_t>(ch)) * 16777619u;
+        }
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bu;
+        hash ^= hash >> 13;
+        return static_cast<uint32_t>((static_cast<uint64_t>(hash) * slot_num) >> 32);
+    }
+
+    // 搜索使所有键落在不同槽位上的种子，找不到时返回 0
+    static constexpr uint32_t FindSeed(const Entry *entries, size_t size, size_t slot_num)
+    {
+        for (uint32_t seed = 1; seed <= MAX_SEED_; ++seed)
+        {
+            bool ok = true;
+            for (size_t i = 1; i < size && ok; ++i)
+            {
+                uint32_t slot = Slot(entries[i].key, seed, slot_num);
+                for (size_t j = 0; j < i && ok; ++j)
+                {
+                    ok = slot != Slot(entries[j].key, seed, slot_num);
+                }
+            }
+            if (ok)
+            {
+                return seed;
+            }
+        }
+        return 0;
+    }
+
+    static constexpr uint32_t MAX_SEED_ = 4096;
+
+    static constexpr size_t MAX_SIZE_ = 255;        // 槽位数是项数的平方，限制项数以限制表占用的内存
+
+    const Entry *entries_;
+
+    size_t size_;
+
+    const uint16_t *slots_;
+
+    size_t slot_num_;
+
+    uint32_t seed_;
+
+    std::deque<std::string> strings_;       // Rebuild() 加入的字符串，deque 追加时不会移动已有的元素
+
+    std::vector<Entry> own_entries_;        // Rebuild() 之后的表
+
+    std::vector<uint16_t> own_slots_;
+};
+
+#endif
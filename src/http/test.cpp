@@ -0,0 +1,465 @@
+#if 0
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <new>
+#include <fstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include "http_request.h"
+#include "http_connection.h"
+
+// 替换全局的分配函数，统计调用次数
+static std::atomic<size_t> allocation_num(0);
+
+void *operator new(size_t size)
+{
+    ++allocation_num;
+    void *ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// 浏览器访问页面时典型的请求报文
+static const std::string REQUEST =
+    "GET /picture HTTP/1.1\r\n"
+    "Host: 127.0.0.1:1316\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: zh-CN,zh;q=0.8,en-US;q=0.5,en;q=0.3\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://127.0.0.1:1316/index.html\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "\r\n";
+
+// 带有大量 Cookie 的请求，扫描分隔符占了解析的大部分时间
+static std::string CookieRequest()
+{
+    std::string request = "GET /index.html HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Cookie: ";
+    for (int i = 0; i < 40; ++i)
+    {
+        request += "session_token_" + std::to_string(i) + "=a3f5c9e1b7d24e6f8a0c2e4b6d8f0a1c3e5; ";
+    }
+    request += "\r\nConnection: keep-alive\r\n\r\n";
+    return request;
+}
+
+// 同一个线程反复解析 request，打印每秒解析的请求数
+void Benchmark(const char *name, const std::string &request, int n)
+{
+    Arena arena;
+    HttpRequest parser(arena);
+    Buffer buf;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i)
+    {
+        buf.Append(request);
+        parser.Initialization();
+        arena.Reset();
+        parser.Parse(buf);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s (%zu bytes): %.0f requests/s, %.2f GB/s\n", name, request.size(), n / seconds,
+           request.size() * n / seconds / 1e9);
+}
+
+// 每次只向读缓冲区追加一个字节，模拟请求被拆成很多个 TCP 分段
+void BenchmarkFragmented(const char *name, const std::string &request, int n)
+{
+    Arena arena;
+    HttpRequest parser(arena);
+    Buffer buf;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i)
+    {
+        for (size_t j = 0; j < request.size(); ++j)
+        {
+            buf.Append(request.data() + j, 1);
+            if (parser.Parse(buf) == HttpRequest::GET_REQUEST)
+            {
+                parser.Initialization();
+                arena.Reset();
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s byte by byte (%zu bytes): %.0f requests/s\n", name, request.size(), n / seconds);
+}
+
+// 解析 request，返回结果，错误码保存在 code 中
+HttpRequest::ParseResult Parse(const std::string &request, int &code)
+{
+    Arena arena;
+    HttpRequest parser(arena);
+    Buffer buf;
+    buf.Append(request);
+    HttpRequest::ParseResult result = parser.Parse(buf);
+    code = parser.GetErrorCode();
+    return result;
+}
+
+int main()
+{
+    Log::GetInstance()->Initialization(3, "./log", ".log", 0);
+
+    // 测试解析结果
+    Arena arena;
+    HttpRequest request(arena);
+    Buffer buf;
+    buf.Append(REQUEST);
+    assert(request.Parse(buf) == HttpRequest::GET_REQUEST);
+    assert(request.GetMethod() == HttpRequest::METHOD_GET);
+    assert(request.GetPath() == "/picture.html");
+    assert(request.GetVersion() == 1);
+    assert(request.GetHeader("accept-encoding") == "gzip, deflate, br");
+    assert(request.GetIsKeepAlive());
+    assert(buf.ReadableBytes() == 0);
+
+    // 测试头部字段的查找：已知字段按编号直接取值，未知字段和重复的已知字段按出现顺序保存
+    assert(request.GetHeader(HttpHeader::HOST) == "127.0.0.1:1316");
+    assert(request.GetHeader("REFERER") == "http://127.0.0.1:1316/index.html");
+    assert(request.GetHeader("upgrade-insecure-requests") == "1");
+    assert(request.GetHeader(HttpHeader::COOKIE).empty() && request.GetHeader("X-Unknown").empty());
+    assert(HttpHeader::Lookup("x-forwarded-for") == HttpHeader::X_FORWARDED_FOR && HttpHeader::Lookup("Hosts") == HttpHeader::UNKNOWN);
+    buf.Append(std::string("GET / HTTP/1.1\r\nHost: a\r\nX-Trace: 1\r\nAccept: a\r\naccept: b\r\nx-trace: 2\r\n\r\n"));
+    request.Initialization();
+    assert(request.Parse(buf) == HttpRequest::GET_REQUEST);
+    assert(request.GetHeader("Accept") == "a" && request.GetHeader("X-TRACE") == "1");
+    buf.Append(std::string("GET //images/./image1.jpg/. HTTP/1.1\r\nHost: a\r\n\r\n"));
+    request.Initialization();
+    assert(request.Parse(buf) == HttpRequest::GET_REQUEST && request.GetPath() == "/images/image1.jpg/");
+
+    // 测试路由表：启动时加入的路由和默认的路由一样查找，同名的项被替换，失败时表保持不变
+    assert(HttpRequest::AddRoutes({{"/home", "/index.html"}, {"/video", "/picture.html"}}));
+    size_t route_num = HttpRequest::GetRouteNum();
+    buf.Append(std::string("GET /home HTTP/1.1\r\nHost: a\r\n\r\nGET /video HTTP/1.1\r\nHost: a\r\n\r\n"));
+    request.Initialization();
+    assert(request.Parse(buf) == HttpRequest::GET_REQUEST && request.GetPath() == "/index.html");
+    request.Initialization();
+    assert(request.Parse(buf) == HttpRequest::GET_REQUEST && request.GetPath() == "/picture.html");
+    std::vector<std::pair<std::string, std::string>> too_many;
+    for (int i = 0; i < 300; ++i)
+    {
+        too_many.emplace_back("/page" + std::to_string(i), "/index.html");
+    }
+    assert(!HttpRequest::AddRoutes(too_many) && HttpRequest::GetRouteNum() == route_num);
+
+    // 测试不完整的请求和错误码
+    int code = 0;
+    assert(Parse(REQUEST.substr(0, 100), code) == HttpRequest::ON_REQUEST);
+    assert(Parse("GET / HTTP/2.0\r\nHost: a\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 505);
+    assert(Parse("PUT / HTTP/1.1\r\nHost: a\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 405);
+    assert(Parse("GET / HTTP/1.1\r\nHost : a\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("GET / HTTP/1.1\r\nHost: a\r\nhost: b\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\nab", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 2\r\nContent-Length: 2\r\n\r\nab", code) == HttpRequest::GET_REQUEST);
+    assert(Parse("GET /" + std::string(9000, 'a'), code) == HttpRequest::BAD_REQUEST && code == 414);
+    assert(Parse("GET / HTTP/1.1\r\nA: " + std::string(40000, 'a'), code) == HttpRequest::BAD_REQUEST && code == 431);
+
+    // 测试分隔符扫描：CR 在数据末尾时等待下一个字节，单独的 CR 和控制字符是非法的
+    assert(Parse("GET / HTTP/1.1\r", code) == HttpRequest::ON_REQUEST);
+    assert(Parse("GET / HTTP/1.1\r\nHost: a\rb\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("GET / HTTP/1.1\r\nHost: a\x01\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("GET / HTTP/1.1\nHost: a\tb\n\n", code) == HttpRequest::GET_REQUEST);
+    printf("scanner: %s\n", HttpScanner::GetImplName());
+
+    // 测试逐字节到达的请求：解析状态在两次调用之间保留，请求体较大时读缓冲区会被重新分配
+    std::string post = "POST /login HTTP/1.1\r\nHost: a\r\nContent-Length: 5000\r\n\r\n" + std::string(5000, 'x');
+    Buffer fragment(64);
+    request.Initialization();
+    for (size_t i = 0; i < post.size(); ++i)
+    {
+        fragment.Append(post.data() + i, 1);
+        assert(request.Parse(fragment) == (i + 1 == post.size() ? HttpRequest::GET_REQUEST : HttpRequest::ON_REQUEST));
+    }
+    assert(request.GetMethod() == HttpRequest::METHOD_POST && request.GetHeader("content-length") == "5000");
+    assert(fragment.ReadableBytes() == 0);
+
+    // 测试分块编码的请求体：原地解码成连续的请求体，之后的数据属于下一个请求
+    std::string chunked = "POST /login HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "5;name=value\r\nhello\r\n7\r\n, world\r\n0\r\nExpires: 0\r\n\r\n";
+    request.Initialization();
+    buf.Append(chunked + REQUEST);
+    assert(request.Parse(buf) == HttpRequest::GET_REQUEST);
+    assert(request.GetBody() == "hello, world");
+    assert(buf.ReadableBytes() == REQUEST.size());
+    buf.RetrieveAll();
+    assert(Parse(chunked.substr(0, chunked.size() - 10), code) == HttpRequest::ON_REQUEST);
+    assert(Parse("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: gzip\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 501);
+    assert(Parse("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhelloX\r\n", code) == HttpRequest::BAD_REQUEST && code == 400);
+    assert(Parse("POST / HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n200000\r\n", code) == HttpRequest::BAD_REQUEST && code == 413);
+
+    // 测试流式处理的请求体：4 MB 的上传分成 4 KB 的分块逐段到达，读缓冲区中不会积累整个请求体
+    size_t uploaded = 0, max_buffered = 0;
+    bool upload_finished = false;
+    HttpRequest::RegisterBodyHandler("/upload", [&](const HttpRequest &) -> HttpRequest::BodyHandler {
+        return [&](std::string_view data, bool is_last) {
+            assert(std::all_of(data.begin(), data.end(), [](char ch) { return ch == 'u'; }));
+            uploaded += data.size();
+            upload_finished = is_last;
+            return true;
+        };
+    });
+    Buffer upload;
+    request.Initialization();
+    upload.Append(std::string("POST /upload HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"));
+    std::string piece = "1000\r\n" + std::string(4096, 'u') + "\r\n";
+    for (int i = 0; i < 1024; ++i)
+    {
+        upload.Append(piece);
+        assert(request.Parse(upload) == HttpRequest::ON_REQUEST);
+        max_buffered = std::max(max_buffered, upload.ReadableBytes());
+    }
+    upload.Append(std::string("0\r\n\r\n"));
+    assert(request.Parse(upload) == HttpRequest::GET_REQUEST);
+    assert(uploaded == (4u << 20) && upload_finished && upload.ReadableBytes() == 0);
+    assert(max_buffered < 2 * 65536);
+    printf("upload: %zu bytes, at most %zu bytes buffered\n", uploaded, max_buffered);
+
+    // 测试表单解析：键和值在 Arena 中解码，重复的键保留最后一个值
+    buf.Append(std::string("POST /form HTTP/1.1\r\nHost: a\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+                           "Content-Length: 32\r\n\r\nname=a+b%21&empty&name=c%2&x=%7e"));
+    request.Initialization();
+    assert(request.Parse(buf) == HttpRequest::GET_REQUEST);
+    assert(request.GetPost("name") == "c%2" && request.GetPost("empty").empty() && request.GetPost("x") == "~");
+
+    // 测试文件缓存：命中时返回同一个映射，超出容量时淘汰最久没有访问的文件，文件变化后重新映射
+    HttpConnection::resource_dir_ = "../../resources/";
+    FileCache *cache = FileCache::GetInstance();
+    assert(cache->Initialization(HttpConnection::resource_dir_, 1 << 20, 1 << 19));
+    struct stat st;
+    auto index = cache->Acquire("../../resources/index.html", st);
+    assert(index && index->size > 0 && S_ISREG(st.st_mode));
+    assert(cache->Acquire("../../resources/index.html", st) == index && cache->GetStats().hit == 1);
+    assert(!cache->Acquire("../../resources/not_exist.html", st) && st.st_mode == 0);
+    assert(!cache->Acquire("../../resources/images", st) && S_ISDIR(st.st_mode));
+    const char *big_files[] = {"../../resources/cache_test_0", "../../resources/cache_test_1",
+                               "../../resources/cache_test_2", "../../resources/cache_test_3"};
+    for (const char *path : big_files)
+    {
+        std::ofstream(path) << std::string(400 << 10, 'c');
+        chmod(path, 0644);
+        assert(cache->Acquire(path, st) && cache->GetStats().size <= (1 << 20));
+    }
+    assert(cache->GetStats().evicted >= 2);
+    std::ofstream(big_files[0]) << std::string(600 << 10, 'c');
+    assert(cache->Acquire(big_files[0], st) != cache->Acquire(big_files[0], st));
+    std::ofstream(big_files[3]) << "changed";
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto changed = cache->Acquire(big_files[3], st);
+    assert(changed && std::string_view(changed->data, changed->size) == "changed");
+    for (const char *path : big_files)
+    {
+        unlink(path);
+    }
+    // 等监视线程处理完删除事件，它分配的内存不计入下面的统计
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 测试 Range 请求：范围按偏移排序，重叠和相邻的范围合并；格式有误或范围过多时忽略 Range，范围都超出文件时回复 416
+    std::string many_ranges = "bytes=0-0";
+    for (int i = 1; i <= 16; ++i)
+    {
+        many_ranges += "," + std::to_string(i * 10) + "-" + std::to_string(i * 10);
+    }
+    const std::string image_etag = cache->Acquire("../../resources/images/image1.jpg", st)->etag;
+    const struct
+    {
+        std::string range;
+        std::string if_range;
+        int code;
+        std::vector<std::pair<size_t, size_t>> parts;
+    } range_cases[] = {
+        {"bytes=0-99", "", 206, {{0, 100}}},
+        {"bytes=-100", "", 206, {{67213, 100}}},
+        {"bytes=67000-", "", 206, {{67000, 313}}},
+        {"Bytes=67000-99999999", "", 206, {{67000, 313}}},
+        {"bytes=30-39, 0-9,5-19 ,, 20-24", "", 206, {{0, 25}, {30, 10}}},
+        {"bytes=0-1", image_etag, 206, {{0, 2}}},
+        {"bytes=0-1", "\"other\"", 200, {{0, 67313}}},
+        {"bytes=0-1", "W/" + image_etag, 200, {{0, 67313}}},
+        {"bytes=67313-, -0", "", 416, {}},
+        {"bytes=5-1", "", 200, {{0, 67313}}},
+        {"bytes=a-b", "", 200, {{0, 67313}}},
+        {"items=0-1", "", 200, {{0, 67313}}},
+        {many_ranges, "", 200, {{0, 67313}}},
+        {"bytes=0-99999999999999999999", "", 206, {{0, 67313}}},
+        {"bytes=99999999999999999999-", "", 416, {}},
+        {"bytes=-99999999999999999999", "", 206, {{0, 67313}}},
+    };
+    for (const auto &test : range_cases)
+    {
+        HttpResponse response(arena);
+        Buffer out;
+        response.Initialization("../../resources/", "/images/image1.jpg", true, 200);
+        response.SetRange(test.range, test.if_range);
+        response.MakeResponse(out);
+        std::vector<std::pair<size_t, size_t>> parts;
+        for (const HttpResponse::Part &part : response.GetParts())
+        {
+            parts.emplace_back(part.offset, part.len);
+        }
+        assert(response.GetCode() == test.code && parts == test.parts);
+        assert((response.GetParts().size() > 1) == !response.GetTrailer().empty());
+        arena.Reset();
+    }
+
+    // 测试持久连接的稳定状态：连接的缓冲区和 Arena 增长到足够大之后，解析请求和生成响应不再调用全局的分配器
+    // 请求的文件都在文件缓存中，也不会调用 stat、open、mmap 和 munmap
+    HttpConnection connection;
+    connection.Initialization(open("/dev/null", O_WRONLY), sockaddr_in{});
+    const std::string requests[] = {
+        REQUEST,
+        CookieRequest(),
+        "GET /images/image1.jpg HTTP/1.1\r\nHost: a\r\n\r\nHEAD /video HTTP/1.1\r\nHost: a\r\n\r\n",
+        "GET /not/exist/page.html HTTP/1.1\r\nHost: a\r\n\r\n",
+        "POST /form HTTP/1.1\r\nHost: a\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: 29\r\n\r\nusername=a%20b&password=c%2Bd",
+        "PUT / HTTP/1.1\r\nHost: a\r\n\r\n",
+    };
+    size_t allocation_begin = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (i == 10)
+        {
+            allocation_begin = allocation_num;
+        }
+        for (const std::string &message : requests)
+        {
+            connection.AppendReadData(message.data(), message.size());
+            assert(connection.Process());
+            connection.Advance(connection.GetToWriteBytes());
+        }
+    }
+    printf("keep-alive: %zu allocations in %d requests\n", allocation_num - allocation_begin, 990 * 7);
+    assert(allocation_num == allocation_begin);
+    connection.Close();
+
+    // 测试事件循环线程中的处理：POST 请求按解析得到的方法交给线程池，请求行之前的空行不影响判断
+    // 已经生成的响应先发送，POST 请求的解析在 Process(false) 中从请求行之后继续
+    const std::string login = "\r\nPOST /login HTTP/1.1\r\nHost: a\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+                              "Content-Length: 29\r\n\r\nusername=a%20b&password=c%2Bd";
+    connection.Initialization(open("/dev/null", O_WRONLY), sockaddr_in{});
+    connection.AppendReadData(login.data(), login.size());
+    assert(!connection.Process(true) && connection.HasDeferredRequest() && connection.HasPendingInput());
+    connection.Close();
+    const std::string form = "GET / HTTP/1.1\r\nHost: a\r\n\r\n\r\nPOST /form HTTP/1.1\r\nHost: a\r\n"
+                             "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 3\r\n\r\na=b";
+    connection.Initialization(open("/dev/null", O_WRONLY), sockaddr_in{});
+    connection.AppendReadData(form.data(), form.size());
+    assert(connection.Process(true) && connection.GetResponseNum() == 1 && connection.HasDeferredRequest());
+    connection.Advance(connection.GetToWriteBytes());
+    assert(!connection.Process(true) && connection.HasDeferredRequest());
+    assert(connection.Process() && connection.GetResponseNum() == 1 && !connection.HasDeferredRequest());
+    assert(!connection.HasPendingInput());
+    connection.Advance(connection.GetToWriteBytes());
+    connection.Close();
+
+    // 测试响应头缓存：200 响应的响应头由第一个响应生成后保存在文件的缓存项中
+    auto image = cache->Acquire("../../resources/images/image1.jpg", st);
+    assert(image->header[0][0].data.empty());
+    assert(image->header[0][1].data.find("HTTP/1.1 200 OK\r\nConnection: keep-alive\r\n") == 0);
+    assert(image->header[0][1].data.find("Content-type: image/jpeg\r\n") != std::string::npos);
+    assert(image->header[0][1].data.find("Content-length: " + std::to_string(image->size)) != std::string::npos);
+
+    // 测试条件请求：ETag 匹配或文件在 If-Modified-Since 之后没有修改时回复 304，不带文件内容
+    HttpResponse response(arena);
+    Buffer out;
+    std::string etag = image->etag;
+    const std::pair<std::string, std::string> conditions[] = {
+        {etag, ""},
+        {"\"other\", W/" + etag, ""},
+        {"*", ""},
+        {"", image->last_modified},
+        {"", "Fri, 31 Dec 9999 23:59:59 GMT"},
+        {"\"other\"", ""},
+        {"\"other\"", image->last_modified},
+        {"", "Thu, 01 Jan 1970 00:00:00 GMT"},
+        {"", "not a date"},
+    };
+    for (size_t i = 0; i < std::size(conditions); ++i)
+    {
+        bool not_modified = i < 5;
+        response.Initialization(HttpConnection::resource_dir_, "/images/image1.jpg", false, 200);
+        response.SetConditions(conditions[i].first, conditions[i].second);
+        response.MakeResponse(out);
+        std::string header = out.RetrieveAllToStr();
+        assert(response.GetCode() == (not_modified ? 304 : 200) && (response.GetFileSize() == 0) == not_modified);
+        assert(header.find("ETag: " + etag + "\r\n") != std::string::npos);
+        assert((header.find("Content-length") == std::string::npos) == not_modified);
+    }
+
+    // 测试 sendfile 模式：较大的文件在响应链中的位置用 sendfile() 发送，因 EAGAIN 中断后从记录的偏移继续
+    // 流水线请求中有多个范围的 Range 请求，各段的头部和文件内容交替出现在响应链中
+    cache->SetSendfileMinSize(4096);
+    cache->Clear();
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    int sndbuf = 8192;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    connection.Initialization(sv[0], sockaddr_in{});
+    std::string pipeline = "GET /images/image1.jpg HTTP/1.1\r\nHost: a\r\n\r\nGET / HTTP/1.1\r\nHost: a\r\n\r\n";
+    pipeline += pipeline;
+    pipeline += "GET /images/image1.jpg HTTP/1.1\r\nHost: a\r\nRange: bytes=10-19,60000-60009\r\n\r\n";
+    connection.AppendReadData(pipeline.data(), pipeline.size());
+    std::string received;
+    char chunk[65536];
+    int rounds = 0, blocked = 0;
+    while (connection.Process())
+    {
+        ++rounds;
+        int error_num = 0;
+        while (connection.Write(error_num) < 0 && error_num == EAGAIN)
+        {
+            ++blocked;
+            received.append(chunk, read(sv[1], chunk, sizeof(chunk)));
+        }
+        assert(connection.GetToWriteBytes() == 0);
+    }
+    for (ssize_t len; (len = recv(sv[1], chunk, sizeof(chunk), MSG_DONTWAIT)) > 0;)
+    {
+        received.append(chunk, len);
+    }
+    std::ifstream image_file("../../resources/images/image1.jpg");
+    std::string image_data((std::istreambuf_iterator<char>(image_file)), std::istreambuf_iterator<char>());
+    assert(rounds == 1 && blocked > 0 && received.find(image_data) != std::string::npos
+           && received.rfind(image_data) != received.find(image_data));
+    assert(received.find("Content-Range: bytes 10-19/67313\r\n\r\n" + image_data.substr(10, 10) + "\r\n--") != std::string::npos);
+    assert(received.find("Content-Range: bytes 60000-60009/67313\r\n\r\n" + image_data.substr(60000, 10) + "\r\n--") != std::string::npos);
+    printf("sendfile: %d rounds, %d blocked writes, %zu bytes\n", rounds, blocked, received.size());
+    connection.Close();
+    close(sv[1]);
+    cache->SetSendfileMinSize(0);
+    cache->Clear();
+
+    // 测试解析速度
+    Benchmark("request", REQUEST, 1000000);
+    Benchmark("cookie request", CookieRequest(), 1000000);
+    BenchmarkFragmented("cookie request", CookieRequest(), 2000);
+}
+
+#endif
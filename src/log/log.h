@@ -61,6 +61,12 @@ public:
         return is_open_;
     }
 
+    // 异步写日志的线程，同步模式下返回 nullptr
+    std::thread *GetWriteThread()
+    {
+        return write_thread_.get();
+    }
+
 private:
     Log();
 
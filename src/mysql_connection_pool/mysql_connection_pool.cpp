@@ -65,8 +65,11 @@ MysqlConnectionPool::MysqlConnectionPool() : is_closed_(false)
     }
     user_count_ = 0;
     // 3、创建两个线程分别用于动态增加和减少Mysql连接数目
-    std::thread(&MysqlConnectionPool::ProduceConnection, this).detach();
-    std::thread(&MysqlConnectionPool::RecycleConnection, this).detach();
+    std::thread producer(&MysqlConnectionPool::ProduceConnection, this);
+    std::thread recycler(&MysqlConnectionPool::RecycleConnection, this);
+    threads_ = {producer.native_handle(), recycler.native_handle()};
+    producer.detach();
+    recycler.detach();
 }
 
 bool MysqlConnectionPool::InitializationParameters(const Json &config)
@@ -5,6 +5,7 @@
 #include <queue>
 #include <mutex>
 #include <thread>
+#include <vector>
 #include <condition_variable>
 #include "mysql_connection.h"
 #include "../json/json.h"
@@ -28,6 +29,12 @@ public:
         return db_name_;
     }
 
+    // 动态增减连接数目的两个子线程的句柄，用于设置 CPU 亲和性
+    const std::vector<std::thread::native_handle_type> &GetThreads() const
+    {
+        return threads_;
+    }
+
     ~MysqlConnectionPool();
 
 private:
@@ -63,6 +70,8 @@ private:
     std::mutex mtx_q_;//, mtx_u_;
 
     std::condition_variable cond_;
+
+    std::vector<std::thread::native_handle_type> threads_;
 };
 
 #endif
\ No newline at end of file
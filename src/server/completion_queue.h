@@ -0,0 +1,43 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <mutex>
+#include <vector>
+
+// 子线程交给事件循环线程的完成项队列（多生产者单消费者）
+// 生产者 Push 后若队列原本为空，需要唤醒事件循环（写 eventfd）；队列非空说明已有一次唤醒尚未处理，
+// 事件循环被唤醒后会一次取走所有完成项，不必重复唤醒
+// 消费者必须先清空 eventfd 再调用 TakeAll()，否则可能把取走之后到达的完成项对应的唤醒一起清掉
+template<typename T>
+class CompletionQueue
+{
+public:
+    CompletionQueue() = default;
+
+    CompletionQueue(const CompletionQueue &) = delete;
+
+    CompletionQueue &operator = (const CompletionQueue &) = delete;
+
+    // 加入一个完成项，返回 true 表示调用者需要唤醒事件循环
+    bool Push(const T &item)
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        items_.push_back(item);
+        return items_.size() == 1;
+    }
+
+    // 取出所有完成项放入 batch（batch 原有的内容被清空），两个数组交替使用，稳定后不再分配内存
+    void TakeAll(std::vector<T> &batch)
+    {
+        batch.clear();
+        std::lock_guard<std::mutex> locker(mtx_);
+        batch.swap(items_);
+    }
+
+private:
+    std::mutex mtx_;
+
+    std::vector<T> items_;
+};
+
+#endif
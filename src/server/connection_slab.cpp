@@ -0,0 +1,6 @@
+#include "connection_slab.h"
+
+ConnectionSlab::ConnectionSlab(size_t capacity) : capacity_(capacity), slots_(new HttpConnection[capacity])
+{
+    assert(capacity_ > 0);
+}
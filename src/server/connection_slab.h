@@ -0,0 +1,54 @@
+#ifndef CONNECTION_SLAB_H
+#define CONNECTION_SLAB_H
+
+#include <memory>
+#include <cassert>
+#include "../http/http_connection.h"
+
+// 预先分配的 HttpConnection 数组，直接以 fd 为下标访问
+// 数组在构造后不再扩容，元素地址在整个运行期间保持不变，工作线程持有的引用不会因为插入新连接而失效
+// fd 被关闭后对象不会析构，而是在下一个使用同一 fd 的连接到来时调用 Initialization() 复用
+class ConnectionSlab
+{
+public:
+    explicit ConnectionSlab(size_t capacity);
+
+    ~ConnectionSlab() = default;
+
+    ConnectionSlab(const ConnectionSlab &) = delete;
+
+    ConnectionSlab &operator = (const ConnectionSlab &) = delete;
+
+    // fd 超出数组范围时返回 nullptr
+    HttpConnection *Get(int fd)
+    {
+        if (fd < 0 || static_cast<size_t>(fd) >= capacity_)
+        {
+            return nullptr;
+        }
+        return &slots_[fd];
+    }
+
+    // 额外检查代数，连接已关闭或 fd 已被新连接复用时返回 nullptr，供延迟执行的任务和定时器回调使用
+    HttpConnection *Get(int fd, uint32_t generation)
+    {
+        HttpConnection *client = Get(fd);
+        if (!client || client->IsClose() || client->GetGeneration() != generation)
+        {
+            return nullptr;
+        }
+        return client;
+    }
+
+    size_t Capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    size_t capacity_;
+
+    std::unique_ptr<HttpConnection[]> slots_;
+};
+
+#endif
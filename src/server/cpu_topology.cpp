@@ -0,0 +1,160 @@
+#include "cpu_topology.h"
+
+CpuTopology::CpuTopology()
+{
+    const char *path = "/sys/devices/system/node";
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        return;
+    }
+    while (struct dirent *entry = readdir(dir))
+    {
+        int node = -1;
+        if (sscanf(entry->d_name, "node%d", &node) != 1 || node < 0)
+        {
+            continue;
+        }
+        std::ifstream file(std::string(path) + "/" + entry->d_name + "/cpulist");
+        std::string list;
+        if (!std::getline(file, list))
+        {
+            continue;
+        }
+        if (static_cast<size_t>(node) >= node_cpus_.size())
+        {
+            node_cpus_.resize(node + 1);
+        }
+        node_cpus_[node] = ParseCpuList(list);
+    }
+    closedir(dir);
+}
+
+std::vector<int> CpuTopology::ParseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    const char *p = list.c_str();
+    while (*p && *p != '\n')
+    {
+        char *end = nullptr;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+        {
+            return {};
+        }
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+            {
+                return {};
+            }
+            p = end;
+        }
+        if (last >= CPU_SETSIZE)
+        {
+            return {};
+        }
+        for (long cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+        else if (*p && *p != '\n')
+        {
+            return {};
+        }
+    }
+    return cpus;
+}
+
+std::string CpuTopology::FormatCpuList(const std::vector<int> &cpus)
+{
+    std::string res;
+    for (size_t i = 0; i < cpus.size(); )
+    {
+        // 合并连续的 CPU 编号
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+        {
+            ++j;
+        }
+        if (!res.empty())
+        {
+            res += ',';
+        }
+        res += std::to_string(cpus[i]);
+        if (j > i)
+        {
+            res += '-' + std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return res;
+}
+
+bool CpuTopology::Bind(pthread_t thread, const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+    {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+int CpuTopology::GetNodeOfCpu(int cpu) const
+{
+    for (size_t node = 0; node < node_cpus_.size(); ++node)
+    {
+        for (int c : node_cpus_[node])
+        {
+            if (c == cpu)
+            {
+                return static_cast<int>(node);
+            }
+        }
+    }
+    return -1;
+}
+
+int CpuTopology::GetNodeOfCpus(const std::vector<int> &cpus) const
+{
+    int node = cpus.empty() ? -1 : GetNodeOfCpu(cpus[0]);
+    for (int cpu : cpus)
+    {
+        if (GetNodeOfCpu(cpu) != node)
+        {
+            return -1;
+        }
+    }
+    return node;
+}
+
+std::string CpuTopology::Describe() const
+{
+    std::string res;
+    for (size_t node = 0; node < node_cpus_.size(); ++node)
+    {
+        if (node_cpus_[node].empty())
+        {
+            continue;
+        }
+        if (!res.empty())
+        {
+            res += ", ";
+        }
+        res += "node" + std::to_string(node) + ": " + FormatCpuList(node_cpus_[node]);
+    }
+    return res.empty() ? "unknown" : res;
+}
@@ -0,0 +1,57 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+
+// 机器的 CPU 和 NUMA 拓扑（单例），启动时从 /sys/devices/system/node 读取一次
+// 不依赖 libnuma：线程用 pthread_setaffinity_np 绑定到 CPU 集合，内存依靠 Linux 默认的 first-touch 策略，
+// 由哪个线程第一次写入，物理页就分配在这个线程所在的节点上
+class CpuTopology
+{
+public:
+    static CpuTopology *GetInstance()
+    {
+        static CpuTopology topology;
+        return &topology;
+    }
+
+    // 解析 "0-3,8,10-11" 格式的 CPU 列表（与 /sys 和 taskset -c 相同），空串或格式错误返回空数组
+    static std::vector<int> ParseCpuList(const std::string &list);
+
+    // 把 CPU 数组格式化为 "0-3,8" 的形式，用于日志
+    static std::string FormatCpuList(const std::vector<int> &cpus);
+
+    // 把线程绑定到 cpus 中的 CPU 上，cpus 为空时什么也不做并返回 true
+    static bool Bind(pthread_t thread, const std::vector<int> &cpus);
+
+    // NUMA 节点数，没有 /sys/devices/system/node 时视为 1 个节点
+    int GetNodeNum() const
+    {
+        return node_cpus_.empty() ? 1 : static_cast<int>(node_cpus_.size());
+    }
+
+    // cpu 所在的 NUMA 节点，未知时返回 -1
+    int GetNodeOfCpu(int cpu) const;
+
+    // 一组 CPU 都在同一个节点上时返回该节点，否则返回 -1
+    int GetNodeOfCpus(const std::vector<int> &cpus) const;
+
+    // 拓扑的描述，如 "node0: 0-15, node1: 16-31"
+    std::string Describe() const;
+
+private:
+    CpuTopology();
+
+    ~CpuTopology() = default;
+
+    std::vector<std::vector<int>> node_cpus_;   // 下标为节点编号，节点编号不连续时中间为空
+};
+
+#endif
@@ -0,0 +1,459 @@
+#include "epoll_event_loop.h"
+
+EpollEventLoop::EpollEventLoop(int id, const LoopOption &option, ThreadPool *thread_pool, ConnectionSlab *users) :
+        EventLoop(id, option, thread_pool, users), epoller_(std::make_unique<Epoller>(1024, users->Capacity())),
+        wakeup_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+        timer_fd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)), is_timer_armed_(false),
+        client_event_(option.inline_fast_path ? option.connection_event & ~EPOLLONESHOT : option.connection_event)
+{
+    assert(wakeup_fd_ >= 0 && timer_fd_ >= 0);
+    epoller_->AddFd(wakeup_fd_, EPOLLIN);
+    epoller_->AddFd(timer_fd_, EPOLLIN);
+}
+
+EpollEventLoop::~EpollEventLoop()
+{
+    close(wakeup_fd_);
+    close(timer_fd_);
+}
+
+void EpollEventLoop::Loop()
+{
+    while (true)
+    {
+        DealDrain();
+        if (is_close_)
+        {
+            break;
+        }
+        // 断开超时的连接，timerfd 在最早的未超时节点到期时唤醒 epoll_wait()，不再依赖它的超时参数
+        ArmTimer();
+        // 就绪列表中还有没处理完的连接时不阻塞
+        int timeout = !ready_.empty() ? 0 : is_draining_ ? DRAIN_CHECK_MS_ : -1;
+        int event_number = 0;
+        // busy_poll：先用 0 超时的 epoll_wait() 轮询一段时间，省去阻塞后被唤醒的开销
+        if (!BusyPoll(timeout, [&] { return (event_number = epoller_->Wait(0)) > 0; }))
+        {
+            event_number = epoller_->Wait(timeout);
+        }
+        ServerStats *stats = ServerStats::GetInstance();
+        stats->epoll_ctl_count += epoller_->TakeCtlCount();
+        stats->epoll_ctl_saved += epoller_->TakeSavedCount();
+        for (int i = 0; i < event_number; ++i)
+        {
+            int fd = epoller_->GetEventFd(i);
+            uint32_t event = epoller_->GetEvents(i);
+            if (fd == listen_fd_)
+            {
+                DealListen();
+                continue;
+            }
+            if (fd == wakeup_fd_)
+            {
+                // 先清空 eventfd 再取完成项，见 CompletionQueue
+                uint64_t value;
+                ssize_t len = read(wakeup_fd_, &value, sizeof(value));
+                (void)len;
+                DealCompletions();
+                continue;
+            }
+            if (fd == timer_fd_)
+            {
+                // 到期的连接在下一轮的 ArmTimer() 中关闭
+                uint64_t expirations;
+                ssize_t len = read(timer_fd_, &expirations, sizeof(expirations));
+                (void)len;
+                is_timer_armed_ = false;
+                continue;
+            }
+            HttpConnection *client = users_->Get(fd);
+            assert(client);
+            if (event & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                CloseConnection(*client);
+            }
+            else if (event & EPOLLIN)
+            {
+                DealRead(*client);
+            }
+            else if (event & EPOLLOUT)
+            {
+                DealWrite(*client);
+            }
+            else
+            {
+                LOG_ERROR("Unexpected event");
+            }
+        }
+        DealReady();
+    }
+}
+
+bool EpollEventLoop::RegisterListen()
+{
+    return epoller_->AddFd(listen_fd_, option_.listen_event | EPOLLIN);
+}
+
+void EpollEventLoop::RegisterClient(HttpConnection &client)
+{
+    epoller_->AddFd(client.GetFd(), client_event_ | EPOLLIN);
+}
+
+void EpollEventLoop::StopListen()
+{
+    epoller_->DeleteFd(listen_fd_);
+    close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void EpollEventLoop::Wakeup()
+{
+    uint64_t one = 1;
+    if (write(wakeup_fd_, &one, sizeof(one)) != sizeof(one))
+    {
+        LOG_ERROR("Loop[%d] wakeup error!", id_);
+    }
+}
+
+void EpollEventLoop::ArmTimer()
+{
+    int timeout = option_.timeout_MS > 0 ? timer_->GetNextTimeout() : -1;
+    if (timeout < 0)
+    {
+        return; // 没有连接，已设置的 timerfd 到期后什么也不做
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    // 连接的超时时间只会因活动而推后，已设置的到期时间更早时不必修改，到期后再按最早的节点重新设置
+    if (is_timer_armed_ && timer_deadline_ <= deadline)
+    {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = timeout / 1000;
+    spec.it_value.tv_nsec = static_cast<long>(timeout % 1000) * 1000000;
+    if (timeout == 0)
+    {
+        spec.it_value.tv_nsec = 1; // 全为 0 表示取消定时器
+    }
+    if (timerfd_settime(timer_fd_, 0, &spec, nullptr) == -1)
+    {
+        LOG_ERROR("Loop[%d] timerfd_settime error: %s", id_, strerror(errno));
+        return;
+    }
+    is_timer_armed_ = true;
+    timer_deadline_ = deadline;
+}
+
+void EpollEventLoop::Post(HttpConnection &client, CompletionType type)
+{
+    if (completions_.Push({client.GetFd(), client.GetGeneration(), type}))
+    {
+        Wakeup();
+    }
+}
+
+void EpollEventLoop::DealCompletions()
+{
+    completions_.TakeAll(batch_);
+    for (const Completion &completion : batch_)
+    {
+        HttpConnection *client = users_->Get(completion.fd, completion.generation);
+        if (!client || !EndTask(*client))
+        {
+            continue; // 连接已经关闭，或 fd 已被新连接复用，或在任务期间超时
+        }
+        switch (completion.type)
+        {
+            case COMPLETION_READ:
+                UpdateClientTimeout(*client);
+                epoller_->DeferModifyFd(completion.fd, client_event_ | EPOLLIN);
+                break;
+            case COMPLETION_WRITE:
+                UpdateClientTimeout(*client);
+                epoller_->DeferModifyFd(completion.fd, client_event_ | EPOLLOUT);
+                break;
+            case COMPLETION_CLOSE:
+                CloseConnection(*client);
+                break;
+        }
+    }
+}
+
+void EpollEventLoop::DealListen()
+{
+    ServerStats *stats = ServerStats::GetInstance();
+    auto start = std::chrono::steady_clock::now();
+    if (IsAcceptQueueFull())
+    {
+        stats->accept_queue_full++;
+    }
+    struct sockaddr_in client_address;
+    int count = 0;
+    // 若监听事件设为了 ET 模式，需要处理完所有连接的请求；LT 模式下同样一次处理多个，减少 epoll_wait 的次数
+    while (count < option_.accept_batch)
+    {
+        socklen_t len = sizeof(client_address);
+        // accept4 在接受连接的同时设置非阻塞和 close-on-exec，省去两次 fcntl 调用
+        int fd = accept4(listen_fd_, (struct sockaddr *)&client_address, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                stats->accept_error++;
+                LOG_WARN("Loop[%d] accept error: %s", id_, strerror(errno));
+            }
+            break;
+        }
+        ++count;
+        AddClient(fd, client_address);
+    }
+    if (count == option_.accept_batch)
+    {
+        stats->accept_batch_full++;
+        // ET 模式下未读完的连接不会再触发事件，重新设置一次监听事件让内核在队列非空时再次通知
+        if (option_.listen_event & EPOLLET)
+        {
+            epoller_->RearmFd(listen_fd_);
+        }
+    }
+    stats->accept_count += count;
+    stats->accept_loop_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void EpollEventLoop::CloseConnection(HttpConnection &client)
+{
+    assert(client.GetFd() > 0);
+    LOG_INFO("Client[%d] quit!", client.GetFd());
+    epoller_->DeleteFd(client.GetFd());
+    client.Close();
+}
+
+void EpollEventLoop::DealRead(HttpConnection &client)
+{
+    assert(client.GetFd() > 0);
+    UpdateClientTimeout(client);
+    client.SetIdle(false);
+    StartRequest(client);
+    if (option_.inline_fast_path)
+    {
+        ReadInline(client);
+        return;
+    }
+    // 使用 bind 将成员函数修改为 void(*)() 的可调用对象（绑定成员函数，必须传递 this），右值
+    if (!thread_pool_->TryAddTask(std::bind(&EpollEventLoop::ReadTask, this, client.GetFd(), client.GetGeneration())))
+    {
+        Shed(client);
+        return;
+    }
+    client.SetBusy(true);
+    ServerStats::GetInstance()->request_pool++;
+}
+
+void EpollEventLoop::ReadTask(int fd, uint32_t generation)
+{
+    HttpConnection *ptr = users_->Get(fd, generation);
+    if (!ptr)
+    {
+        return; // 连接在任务排队期间已经关闭
+    }
+    HttpConnection &client = *ptr;
+    int res = -1, error_num = 0;
+    res = client.Read(error_num);
+    if (res <= 0 && error_num != EAGAIN)
+    {
+        Post(client, COMPLETION_CLOSE);
+        return;
+    }
+    Process(client);
+}
+
+void EpollEventLoop::DealWrite(HttpConnection &client)
+{
+    assert(client.GetFd() > 0);
+    UpdateClientTimeout(client);
+    if (option_.inline_fast_path)
+    {
+        if (WriteInline(client))
+        {
+            StartRequest(client);
+            ProcessInline(client);
+        }
+        return;
+    }
+    client.SetBusy(true);
+    thread_pool_->AddTask(std::bind(&EpollEventLoop::WriteTask, this, client.GetFd(), client.GetGeneration()));
+}
+
+void EpollEventLoop::WriteTask(int fd, uint32_t generation)
+{
+    HttpConnection *ptr = users_->Get(fd, generation);
+    if (!ptr)
+    {
+        return;
+    }
+    HttpConnection &client = *ptr;
+    int res = -1, error_num = 0;
+    // 由客户端保证在不出错的前提下一次性写完所有数据
+    res = WriteResponse(client, error_num);
+    if (client.GetToWriteBytes() == 0)
+    {
+        // 写任务处理完毕
+        FinishRequest(client);
+        if (client.IsKeepAlive())
+        {
+            StartRequest(client);
+            Process(client);
+            return;
+        }
+    }
+    if (res < 0 && error_num == EAGAIN)
+    {
+        // 继续传输
+        Post(client, COMPLETION_WRITE);
+        return;
+    }
+    Post(client, COMPLETION_CLOSE);
+}
+
+void EpollEventLoop::ProcessTask(int fd, uint32_t generation)
+{
+    HttpConnection *client = users_->Get(fd, generation);
+    if (client)
+    {
+        Process(*client);
+    }
+}
+
+void EpollEventLoop::Process(HttpConnection &client)
+{
+    if (client.Process())
+    {
+        Post(client, COMPLETION_WRITE);
+    }
+    else
+    {
+        // 读缓冲区为空说明上一个请求已经响应完毕，连接空闲，排空时可以直接关闭
+        client.SetIdle(!client.HasPendingInput());
+        Post(client, COMPLETION_READ);
+    }
+}
+
+void EpollEventLoop::ReadInline(HttpConnection &client)
+{
+    int error_num = 0;
+    ssize_t res = client.Read(error_num);
+    if (res <= 0 && error_num != EAGAIN)
+    {
+        CloseConnection(client);
+        return;
+    }
+    ProcessInline(client);
+}
+
+void EpollEventLoop::ProcessInline(HttpConnection &client)
+{
+    for (int round = 0; ; ++round)
+    {
+        if (round == INLINE_ROUNDS_ && client.HasPendingInput())
+        {
+            // 本次事件的处理预算用完，读缓冲区中剩下的请求放到就绪列表，等这一轮其它连接的事件处理完后再继续
+            ready_.push_back({client.GetFd(), client.GetGeneration()});
+            return;
+        }
+        if (client.Process(true))
+        {
+            ServerStats::GetInstance()->request_inline += client.GetResponseNum();
+            // socket 的发送缓冲区通常有空间，直接发送，不必再等一次 EPOLLOUT
+            if (!WriteInline(client))
+            {
+                return;
+            }
+            // 发送完毕，读缓冲区中可能还有下一个请求（pipelining），同样先判断能否直接处理
+            StartRequest(client);
+            continue;
+        }
+        if (client.HasDeferredRequest())
+        {
+            // 连接没有设置 EPOLLONESHOT，交给子线程期间先移出 epoll，子线程处理完后由事件循环重新加入
+            epoller_->DeleteFd(client.GetFd());
+            if (!thread_pool_->TryAddTask(std::bind(&EpollEventLoop::ProcessTask, this, client.GetFd(), client.GetGeneration())))
+            {
+                Shed(client);
+                return;
+            }
+            client.SetBusy(true);
+            ServerStats::GetInstance()->request_pool++;
+            return;
+        }
+        client.SetIdle(!client.HasPendingInput());
+        epoller_->DeferModifyFd(client.GetFd(), client_event_ | EPOLLIN);
+        return;
+    }
+}
+
+bool EpollEventLoop::WriteInline(HttpConnection &client)
+{
+    int error_num = 0;
+    ssize_t res = WriteResponse(client, error_num);
+    if (client.GetToWriteBytes() == 0)
+    {
+        FinishRequest(client);
+        if (client.IsKeepAlive())
+        {
+            return true;
+        }
+    }
+    else if (res < 0 && error_num == EAGAIN)
+    {
+        epoller_->DeferModifyFd(client.GetFd(), client_event_ | EPOLLOUT);
+        return false;
+    }
+    CloseConnection(client);
+    return false;
+}
+
+void EpollEventLoop::DealReady()
+{
+    ready_batch_.swap(ready_);
+    for (const ReadyClient &ready : ready_batch_)
+    {
+        HttpConnection *client = users_->Get(ready.fd, ready.generation);
+        // 期间连接可能已经交给线程池，或者响应没有发完在等待 EPOLLOUT，这些情况由对应的处理继续
+        if (client && !client->IsBusy() && client->GetToWriteBytes() == 0)
+        {
+            ProcessInline(*client);
+        }
+    }
+    ready_batch_.clear();
+}
+
+ssize_t EpollEventLoop::WriteResponse(HttpConnection &client, int &error_num)
+{
+    // 整条响应链在内存中时 writev 本来就一次交给内核，塞住连接只会多两次 setsockopt
+    // 只有响应头和 sendfile() 发送的文件内容分两次系统调用时才需要 TCP_CORK 把它们合并成满的分段
+    if (!option_.tcp.cork || !client.HasSendfile())
+    {
+        return client.Write(error_num);
+    }
+    int on = 1, off = 0;
+    setsockopt(client.GetFd(), IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    ssize_t res = client.Write(error_num);
+    if (client.GetToWriteBytes() == 0)
+    {
+        // 响应发送完毕，取消 TCP_CORK 把最后不足一个分段的数据立即发出
+        setsockopt(client.GetFd(), IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+    return res;
+}
+
+void EpollEventLoop::Shed(HttpConnection &client)
+{
+    ServerStats::GetInstance()->request_shed++;
+    // 读走请求数据，避免关闭时接收缓冲区中还有数据导致内核发送 RST，客户端收不到 503
+    int error_num = 0;
+    client.Read(error_num);
+    client.MakeErrorResponse(503, option_.retry_after);
+    client.Write(error_num);
+    CloseConnection(client);
+}
@@ -0,0 +1,146 @@
+#ifndef EPOLL_EVENT_LOOP_H
+#define EPOLL_EVENT_LOOP_H
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "event_loop.h"
+#include "completion_queue.h"
+#include "../epoller/epoller.h"
+
+// 基于 epoll 的事件循环：反应堆线程只负责 epoll_wait() 和 accept，读写都交给线程池中的子线程完成
+// 开启 inline_fast_path 时静态资源请求在事件循环线程直接处理，对监听事件的修改推迟到下一次 epoll_wait() 之前统一提交
+// 子线程不直接修改 epoll 和定时器：处理结果（继续读、继续写、关闭）放入完成队列并通过 eventfd 唤醒事件循环，由事件循环批量处理
+// 连接超时由 timerfd 唤醒，epoll_wait() 本身一直阻塞
+class EpollEventLoop : public EventLoop
+{
+public:
+    EpollEventLoop(int id, const LoopOption &option, ThreadPool *thread_pool, ConnectionSlab *users);
+
+    ~EpollEventLoop() override;
+
+    // 调用 epoll_wait() 监听事件并分发，直到事件循环被关闭
+    void Loop() override;
+
+    const char *GetBackendName() const override
+    {
+        return "epoll";
+    }
+
+protected:
+    bool RegisterListen() override;
+
+    void RegisterClient(HttpConnection &client) override;
+
+    void StopListen() override;
+
+    void Wakeup() override;
+
+    void CloseConnection(HttpConnection &client) override;
+
+private:
+    // 子线程处理完一个连接后交给事件循环的操作
+    enum CompletionType : uint8_t
+    {
+        COMPLETION_READ,    // 更新超时时间，继续监听读事件
+        COMPLETION_WRITE,   // 更新超时时间，监听写事件
+        COMPLETION_CLOSE,   // 关闭连接
+    };
+
+    struct Completion
+    {
+        int fd;
+        uint32_t generation;
+        CompletionType type;
+    };
+
+    // 处理预算用完、读缓冲区中还有请求的连接
+    struct ReadyClient
+    {
+        int fd;
+        uint32_t generation;
+    };
+
+private: // 事件循环线程调用的函数
+    // 关闭到期的连接，并在最早的未超时连接到期时让 timerfd 唤醒 epoll_wait()
+    // 只在到期时间提前时调用 timerfd_settime()，连接的超时时间推后时等 timerfd 到期再重新设置
+    void ArmTimer();
+
+    // 取出完成队列中的所有完成项，修改监听事件（推迟到下一次 epoll_wait() 之前统一提交）或关闭连接
+    void DealCompletions();
+
+    // 当检测到有新的连接时，用 accept4() 批量接受连接（最多 accept_batch 个）并进行相应的处理
+    void DealListen();
+
+    // 更新当前客户的最近访问时间，并将读任务 (ReadTask) 交给工作队列，让子线程去处理
+    // 开启 inline_fast_path 时直接在事件循环线程读取和处理
+    void DealRead(HttpConnection &client);
+
+    // 更新当前客户的最近访问时间，并将写任务 (WriteTask) 交给工作队列，让子线程去处理
+    // 开启 inline_fast_path 时直接在事件循环线程发送
+    void DealWrite(HttpConnection &client);
+
+    // inline_fast_path：读取请求数据并交给 ProcessInline()
+    void ReadInline(HttpConnection &client);
+
+    // inline_fast_path：不访问数据库的请求直接解析并生成响应，然后立即尝试发送；POST 请求交给线程池 (ProcessTask)
+    // 发送完毕后继续处理读缓冲区中的下一批请求，一次事件最多处理 INLINE_ROUNDS_ 批，剩下的放入就绪列表
+    void ProcessInline(HttpConnection &client);
+
+    // inline_fast_path：发送响应。发送完毕且保持连接时返回 true，由调用者继续处理下一个请求；
+    // 否则已经改为监听写事件或关闭了连接，返回 false
+    bool WriteInline(HttpConnection &client);
+
+    // 每轮 epoll_wait() 的事件处理完后，继续处理就绪列表中的连接，避免一个流水线很深的连接让同一事件循环上的其它连接饿死
+    void DealReady();
+
+    // 线程池过载，直接回复 503 并关闭连接
+    void Shed(HttpConnection &client);
+
+private: // 事件循环线程和子线程都会调用的函数
+    // 调用 HttpConnection 的 Write，开启 tcp.cork 且响应链中有 sendfile() 段时在写响应期间设置 TCP_CORK
+    ssize_t WriteResponse(HttpConnection &client, int &error_num);
+
+private: // 子线程调用的函数
+    // 把对 client 的操作交给事件循环，队列原本为空时唤醒事件循环
+    void Post(HttpConnection &client, CompletionType type);
+
+    // 调用 HttpConnection 的 Read()，读取成功的话对读取的请求进行处理
+    // 任务只保存 fd 和连接的代数，执行时若发现连接已过期则直接丢弃
+    void ReadTask(int fd, uint32_t generation);
+
+    // 调用 HttpConnection 的 Write
+    void WriteTask(int fd, uint32_t generation);
+
+    // inline_fast_path 模式下交给线程池的请求：数据已由事件循环线程读好，只需处理
+    void ProcessTask(int fd, uint32_t generation);
+
+    // 调用 HttpConnection 的 Process，解析请求并生成响应。若成功则让事件循环监听写事件，否则继续监听读事件
+    void Process(HttpConnection &client);
+
+private:
+    std::unique_ptr<Epoller> epoller_;
+
+    int wakeup_fd_;     // 其它线程通过 eventfd 唤醒阻塞在 epoll_wait() 的事件循环
+
+    int timer_fd_;      // 最早的未超时连接到期时唤醒事件循环
+
+    bool is_timer_armed_;
+
+    std::chrono::steady_clock::time_point timer_deadline_;  // timerfd 设置的到期时间
+
+    CompletionQueue<Completion> completions_;
+
+    std::vector<Completion> batch_;     // 事件循环线程一次取出的完成项
+
+    std::vector<ReadyClient> ready_;        // 就绪列表：本次事件的处理预算用完、读缓冲区中还有请求的连接
+
+    std::vector<ReadyClient> ready_batch_;  // 正在处理的就绪列表，处理期间新加入的连接留到下一轮
+
+    static const int INLINE_ROUNDS_ = 4;    // 一次事件最多处理几批请求（每批最多 HttpConnection::MAX_PIPELINE_ 个）
+
+    // 客户端连接注册的事件。开启 inline_fast_path 时去掉 EPOLLONESHOT：请求在事件循环线程处理，
+    // 长连接上的每个请求处理完后注册的事件不变，不必再调用 epoll_ctl 重新激活；交给线程池的请求期间把连接移出 epoll
+    uint32_t client_event_;
+};
+
+#endif
@@ -0,0 +1,404 @@
+#include "event_loop.h"
+#include "epoll_event_loop.h"
+#include "uring_event_loop.h"
+
+EventLoop::EventLoop(int id, const LoopOption &option, ThreadPool *thread_pool, ConnectionSlab *users) :
+        id_(id), option_(option), listen_fd_(-1), is_close_(false), thread_pool_(thread_pool),
+        timer_(std::make_unique<HeapTimer>()), users_(users), owned_(users->Capacity(), 0),
+        request_start_(users->Capacity()), drain_requested_(false),
+        is_draining_(false), node_(-1)
+{
+    assert(thread_pool_ && users_);
+}
+
+EventLoop::~EventLoop()
+{
+    if (listen_fd_ >= 0)
+    {
+        close(listen_fd_);
+    }
+    is_close_ = true;
+}
+
+std::unique_ptr<EventLoop> EventLoop::Create(const std::string &backend, int id, const LoopOption &option,
+                                             ThreadPool *thread_pool, ConnectionSlab *users)
+{
+    if (backend == "io_uring")
+    {
+        // 用事件循环实际使用的参数创建环并注册接收缓冲区，任何一步失败都退回 epoll
+        // 接收缓冲区环和 multishot accept 都需要 5.19，两者一起检查
+        auto ring = std::make_unique<IoUring>(option.uring_entries);
+        if (ring->IsValid() && ring->SetupBufferRing(0, option.uring_buffer_num, option.uring_buffer_size))
+        {
+            return std::make_unique<UringEventLoop>(id, option, thread_pool, users, std::move(ring));
+        }
+        LOG_WARN("Loop[%d] create io_uring or register buffer ring error: %s, fall back to epoll", id, strerror(errno));
+    }
+    else if (backend != "epoll")
+    {
+        LOG_WARN("Loop[%d] unknown io backend: %s, use epoll", id, backend.c_str());
+    }
+    return std::make_unique<EpollEventLoop>(id, option, thread_pool, users);
+}
+
+bool EventLoop::InitSocket(int inherited_fd)
+{
+    if (option_.port > 65535 || option_.port < 1024)
+    {
+        LOG_ERROR("Port: %d error!",  option_.port);
+        return false;
+    }
+
+    if (inherited_fd >= 0 ? !InheritSocket(inherited_fd) : !CreateSocket())
+    {
+        return false;
+    }
+
+    if (!RegisterListen())
+    {
+        LOG_ERROR("Add listen error!");
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    LOG_INFO("Loop[%d] %s Socket Success! listen fd : %d, backlog : %d, backend : %s", id_,
+             inherited_fd >= 0 ? "Inherit" : "Init", listen_fd_, option_.backlog, GetBackendName());
+    return true;
+}
+
+void EventLoop::Drain()
+{
+    drain_requested_ = true;
+    Wakeup();
+}
+
+bool EventLoop::CreateSocket()
+{
+    // 直接创建非阻塞的监听 socket，省去之后的 fcntl 调用
+    if ((listen_fd_ = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+    {
+        LOG_ERROR("Create socket error!");
+        return false;
+    }
+
+    // 根据参数设置是否优雅关闭，设置超时时间为 1s
+    struct linger opt_linger = {0};
+    if (option_.open_linger)
+    {
+        opt_linger.l_onoff = 1;
+        opt_linger.l_linger = 1;
+    }
+    if (setsockopt(listen_fd_, SOL_SOCKET, SO_LINGER, &opt_linger, sizeof(opt_linger)) == -1)
+    {
+        LOG_ERROR("Init linger error!");
+        close(listen_fd_);
+        return false;
+    }
+
+    // 设置端口复用
+    int reuse = 1;
+    if ((setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse))) == -1)
+    {
+        LOG_ERROR("set socket setsockopt error !");
+        close(listen_fd_);
+        return false;
+    }
+
+    // 多个事件循环各自创建监听 socket 绑定同一端口，由内核按四元组哈希把新连接分给不同的 socket
+    if (option_.reuse_port && setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1)
+    {
+        LOG_ERROR("set socket SO_REUSEPORT error !");
+        close(listen_fd_);
+        return false;
+    }
+
+    // 接收缓冲区必须在 listen() 之前设置，三次握手时才能按它协商窗口扩大因子
+    if (!SetListenOption())
+    {
+        close(listen_fd_);
+        return false;
+    }
+
+    struct sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(option_.port);
+    if (bind(listen_fd_, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        LOG_ERROR("Bind Port: %d error!", option_.port);
+        close(listen_fd_);
+        return false;
+    }
+
+    // backlog 会被内核截断为 /proc/sys/net/core/somaxconn
+    if (listen(listen_fd_, option_.backlog) == -1)
+    {
+        LOG_ERROR("Listen port: %d error!", option_.port);
+        close(listen_fd_);
+        return false;
+    }
+
+    return true;
+}
+
+bool EventLoop::InheritSocket(int fd)
+{
+    int accept_conn = 0;
+    socklen_t len = sizeof(accept_conn);
+    struct sockaddr_in address;
+    socklen_t address_len = sizeof(address);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accept_conn, &len) == -1 || !accept_conn ||
+        getsockname(fd, (struct sockaddr *)&address, &address_len) == -1 || address.sin_family != AF_INET ||
+        ntohs(address.sin_port) != option_.port)
+    {
+        LOG_ERROR("Inherited fd %d is not a socket listening on port %d!", fd, option_.port);
+        return false;
+    }
+    // 继承来的 fd 没有 close-on-exec 标志，和新创建的监听 socket 保持一致
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        LOG_ERROR("Set inherited fd %d flags error!", fd);
+        return false;
+    }
+    listen_fd_ = fd;
+    // 配置可能在升级时修改了，重新设置一次
+    if (!SetListenOption())
+    {
+        listen_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::SetListenOption()
+{
+    const TcpOption &tcp = option_.tcp;
+    if (tcp.rcvbuf > 0 && setsockopt(listen_fd_, SOL_SOCKET, SO_RCVBUF, &tcp.rcvbuf, sizeof(tcp.rcvbuf)) == -1)
+    {
+        LOG_ERROR("set socket SO_RCVBUF error !");
+        return false;
+    }
+    if (tcp.sndbuf > 0 && setsockopt(listen_fd_, SOL_SOCKET, SO_SNDBUF, &tcp.sndbuf, sizeof(tcp.sndbuf)) == -1)
+    {
+        LOG_ERROR("set socket SO_SNDBUF error !");
+        return false;
+    }
+    // 客户端只建立连接而不发送请求时不唤醒事件循环，超时后内核仍会把连接交给 accept
+    if (tcp.defer_accept > 0 &&
+        setsockopt(listen_fd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &tcp.defer_accept, sizeof(tcp.defer_accept)) == -1)
+    {
+        LOG_ERROR("set socket TCP_DEFER_ACCEPT error !");
+        return false;
+    }
+    // 开启后请求可以随 SYN 一起到达；内核未开启服务端 TFO (net.ipv4.tcp_fastopen & 2) 时不生效，不算错误
+    if (tcp.fastopen > 0 &&
+        setsockopt(listen_fd_, IPPROTO_TCP, TCP_FASTOPEN, &tcp.fastopen, sizeof(tcp.fastopen)) == -1)
+    {
+        LOG_WARN("set socket TCP_FASTOPEN error: %s", strerror(errno));
+    }
+    CheckBusyPollOption();
+    return true;
+}
+
+void EventLoop::CheckBusyPollOption()
+{
+    // 超过 net.core.busy_read 的 SO_BUSY_POLL 需要 CAP_NET_ADMIN，失败时不再对每个连接重复尝试
+    int busy_poll = option_.socket_busy_poll_us, on = 1;
+    if (busy_poll > 0 && setsockopt(listen_fd_, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) == -1)
+    {
+        LOG_WARN("set socket SO_BUSY_POLL error: %s, disable it", strerror(errno));
+        option_.socket_busy_poll_us = 0;
+    }
+    if (option_.prefer_busy_poll && setsockopt(listen_fd_, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof(on)) == -1)
+    {
+        LOG_WARN("set socket SO_PREFER_BUSY_POLL error: %s, disable it", strerror(errno));
+        option_.prefer_busy_poll = false;
+    }
+}
+
+bool EventLoop::IsAcceptQueueFull()
+{
+    // 对处于 LISTEN 状态的 socket，tcpi_unacked 为当前全连接队列长度，tcpi_sacked 为 backlog
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(listen_fd_, IPPROTO_TCP, TCP_INFO, &info, &len) == -1)
+    {
+        return false;
+    }
+    return info.tcpi_sacked > 0 && info.tcpi_unacked >= info.tcpi_sacked;
+}
+
+bool EventLoop::AddClient(int fd, const sockaddr_in &address)
+{
+    assert(fd > 0);
+    HttpConnection *client = users_->Get(fd);
+    if (!client)
+    {
+        ServerStats::GetInstance()->reject_count++;
+        SendError(fd, 503);
+        LOG_WARN("Clients is full!");
+        return false;
+    }
+    SetClientOption(fd);
+    client->PlaceBuffers(node_);
+    client->Initialization(fd, address);
+    owned_[fd] = client->GetGeneration();
+    if (option_.timeout_MS > 0) // 加入到定时器链表中
+    {
+        timer_->Add(fd, option_.timeout_MS, std::bind(&EventLoop::CloseExpired, this, fd, client->GetGeneration()));
+    }
+    RegisterClient(*client);
+    LOG_INFO("Loop[%d] Client[%d] in!", id_, client->GetFd());
+    return true;
+}
+
+bool EventLoop::BindThread(const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+    {
+        return true;
+    }
+    if (!CpuTopology::Bind(pthread_self(), cpus))
+    {
+        LOG_WARN("Loop[%d] bind to cpu %s error!", id_, CpuTopology::FormatCpuList(cpus).c_str());
+        return false;
+    }
+    CpuTopology *topology = CpuTopology::GetInstance();
+    node_ = topology->GetNodeNum() > 1 ? topology->GetNodeOfCpus(cpus) : -1;
+    return true;
+}
+
+int EventLoop::GetNextTimeout()
+{
+    // 默认 epoll_wait / io_uring_enter 阻塞
+    int timeout = option_.timeout_MS > 0 ? timer_->GetNextTimeout() : -1;
+    if (is_draining_ && (timeout < 0 || timeout > DRAIN_CHECK_MS_))
+    {
+        // 排空期间连接可能由子线程关闭，定期检查是否已经排空
+        timeout = DRAIN_CHECK_MS_;
+    }
+    return timeout;
+}
+
+void EventLoop::DealDrain()
+{
+    if (!is_draining_)
+    {
+        if (!drain_requested_)
+        {
+            return;
+        }
+        is_draining_ = true;
+        drain_deadline_ = Clock::now() + MS(option_.drain_timeout_MS);
+        StopListen();
+        LOG_INFO("Loop[%d] stop accepting, start draining", id_);
+    }
+    bool is_expired = Clock::now() >= drain_deadline_;
+    size_t alive = 0;
+    for (size_t fd = 0; fd < owned_.size(); ++fd)
+    {
+        if (owned_[fd] == 0)
+        {
+            continue;
+        }
+        HttpConnection *client = users_->Get(static_cast<int>(fd), owned_[fd]);
+        if (!client)
+        {
+            owned_[fd] = 0;
+            continue;
+        }
+        // 子线程可能正在使用交给线程池的连接，到期后也只能记下，由完成项的处理关闭
+        if (client->IsBusy())
+        {
+            if (is_expired)
+            {
+                client->SetClosePending();
+            }
+            ++alive;
+            continue;
+        }
+        // 空闲的长连接直接关闭；正在处理的请求等它响应完毕后由 I/O 后端关闭（IsKeepAlive() 此时返回 false）
+        if (client->IsIdle() || is_expired)
+        {
+            CloseConnection(*client);
+            owned_[fd] = 0;
+            continue;
+        }
+        ++alive;
+    }
+    // 到期后剩下的都是交给线程池的连接，等它们的任务完成后关闭
+    if (alive == 0)
+    {
+        LOG_INFO("Loop[%d] drained%s", id_, is_expired ? " (timeout, remaining connections closed)" : "");
+        is_close_ = true;
+    }
+}
+
+void EventLoop::SetClientOption(int fd)
+{
+    // 缓冲区大小已经从监听 socket 继承，这里设置 TCP_NODELAY 和 busy poll 相关的选项
+    int on = 1;
+    if (option_.tcp.nodelay && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1)
+    {
+        LOG_WARN("set client[%d] TCP_NODELAY error: %s", fd, strerror(errno));
+    }
+    if (option_.socket_busy_poll_us > 0)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &option_.socket_busy_poll_us, sizeof(option_.socket_busy_poll_us));
+    }
+    if (option_.prefer_busy_poll)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof(on));
+    }
+}
+
+void EventLoop::CloseExpired(int fd, uint32_t generation)
+{
+    HttpConnection *client = users_->Get(fd, generation);
+    if (!client)
+    {
+        return;
+    }
+    if (client->IsBusy())
+    {
+        client->SetClosePending(); // 子线程可能正在处理该连接，任务完成后再关闭
+        return;
+    }
+    CloseConnection(*client);
+}
+
+bool EventLoop::EndTask(HttpConnection &client)
+{
+    client.SetBusy(false);
+    if (client.IsClosePending())
+    {
+        CloseConnection(client);
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::UpdateClientTimeout(HttpConnection &client)
+{
+    assert(client.GetFd() > 0);
+    if (option_.timeout_MS > 0)
+    {
+        timer_->AdjustTime(client.GetFd(), option_.timeout_MS);
+    }
+}
+
+void EventLoop::SendError(int fd, int code)
+{
+    assert(fd > 0);
+    Buffer buf(256);
+    Arena arena(512);
+    HttpResponse response(arena);
+    response.Initialization(HttpConnection::resource_dir_, "", false, code);
+    response.MakeErrorResponse(buf, option_.retry_after);
+    if (send(fd, buf.GetReadPtr(), buf.ReadableBytes(), MSG_NOSIGNAL) == -1)
+    {
+        LOG_WARN("send error to client[%d] !", fd);
+    }
+    close(fd);
+}
@@ -0,0 +1,258 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <netinet/tcp.h>
+#include <atomic>
+#include <vector>
+
+#include "../thread_pool/thread_pool.h"
+#include "../http/http_connection.h"
+#include "connection_slab.h"
+#include "server_stats.h"
+#include "cpu_topology.h"
+#include "../timer/heap_timer.h"
+#include "../log/log.h"
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69      // Linux 5.11
+#endif
+
+// 监听 socket 和客户端 socket 的 TCP 参数，对应配置文件中的 Server.tcp
+struct TcpOption
+{
+    bool nodelay;               // TCP_NODELAY：关闭 Nagle 算法，响应的最后一个不足 MSS 的分段不必等待 ACK
+
+    bool cork;                  // 响应头和文件内容合并成满的分段发送：epoll 后端在用 sendfile() 发送文件的响应期间设置 TCP_CORK，io_uring 后端整条响应链本来就由一个 sendmsg 发送
+
+    int defer_accept;           // TCP_DEFER_ACCEPT（秒）：连接上有数据到达后才唤醒 accept，0 表示不设置
+
+    int fastopen;               // TCP_FASTOPEN 的队列长度，0 表示不开启
+
+    int sndbuf;                 // SO_SNDBUF（字节），0 表示使用系统默认值（自动调整）
+
+    int rcvbuf;                 // SO_RCVBUF（字节），0 表示使用系统默认值（自动调整）
+};
+
+// 事件循环的运行参数，由 WebServer 根据配置文件统一生成后交给每个事件循环
+struct LoopOption
+{
+    int port;                   // 端口
+
+    int timeout_MS;             // 超时时间
+
+    bool open_linger;           // 是否启用linger功能
+
+    bool reuse_port;            // 是否设置 SO_REUSEPORT，多个事件循环各自监听同一端口时需要开启
+
+    int backlog;                // listen() 的全连接队列长度
+
+    int accept_batch;           // 一次唤醒最多 accept 的连接数，剩余的留到下一轮，避免新连接饿死已有连接
+
+    uint32_t listen_event;      // 默认的服务器的监听事件
+
+    uint32_t connection_event;  // 默认的客户端连接的监听事件
+
+    int uring_entries;          // io_uring 后端：提交队列长度
+
+    int uring_buffer_num;       // io_uring 后端：交给内核挑选的接收缓冲区个数（2 的幂）
+
+    int uring_buffer_size;      // io_uring 后端：每个接收缓冲区的大小
+
+    int drain_timeout_MS;       // 排空连接的最长时间，超时后强制关闭剩余的连接
+
+    bool inline_fast_path;      // 是否在事件循环线程直接处理不访问数据库的请求，省去线程池的切换
+
+    int retry_after;            // 过载时 503 响应的 Retry-After（秒）
+
+    int busy_poll_us;           // 阻塞等待 I/O 之前先以不阻塞的方式轮询多久（us），0 表示不轮询
+
+    int socket_busy_poll_us;    // 客户端 socket 的 SO_BUSY_POLL（us），0 表示不设置
+
+    bool prefer_busy_poll;      // 客户端 socket 是否设置 SO_PREFER_BUSY_POLL
+
+    TcpOption tcp;
+};
+
+// 一个事件循环（反应堆）：拥有独立的监听 socket 和 HeapTimer，连接对象统一存放在共享的 ConnectionSlab 中
+// 连接由哪个事件循环 accept，整个生命周期内就一直由该事件循环负责
+// 具体如何等待和完成 I/O 由派生类（I/O 后端）实现：EpollEventLoop 基于 epoll 就绪通知，UringEventLoop 基于 io_uring 完成通知
+class EventLoop
+{
+public:
+    EventLoop(int id, const LoopOption &option, ThreadPool *thread_pool, ConnectionSlab *users);
+
+    virtual ~EventLoop();
+
+    // 根据名字创建对应 I/O 后端的事件循环，目前支持 "epoll" 和 "io_uring"
+    static std::unique_ptr<EventLoop> Create(const std::string &backend, int id, const LoopOption &option,
+                                             ThreadPool *thread_pool, ConnectionSlab *users);
+
+    // 初始化socket，完成绑定，监听操作，并把监听 socket 交给 I/O 后端
+    // inherited_fd >= 0 时直接使用从旧进程继承的监听 socket，不再创建和绑定
+    bool InitSocket(int inherited_fd = -1);
+
+    // 请求事件循环排空连接（线程安全）：停止 accept，关闭空闲的长连接，等正在处理的请求响应完毕后退出 Loop()
+    void Drain();
+
+    // 把调用线程（即将运行 Loop() 的线程）绑定到 cpus 上，cpus 为空时不绑定
+    // cpus 都在同一个 NUMA 节点上且机器有多个节点时，之后 accept 的连接的缓冲区在该节点上重新分配
+    bool BindThread(const std::vector<int> &cpus);
+
+    // 等待 I/O 事件并分发，直到事件循环被关闭
+    virtual void Loop() = 0;
+
+    // I/O 后端的名字，用于日志
+    virtual const char *GetBackendName() const = 0;
+
+    int GetId() const
+    {
+        return id_;
+    }
+
+    int GetListenFd() const
+    {
+        return listen_fd_;
+    }
+
+protected: // 由派生类实现的 I/O 后端相关操作
+    // 开始监听 listen_fd_ 上的新连接
+    virtual bool RegisterListen() = 0;
+
+    // 停止监听新连接并关闭 listen_fd_（监听 socket 可能已交给新进程，不能 shutdown）
+    virtual void StopListen() = 0;
+
+    // 唤醒阻塞在等待 I/O 的事件循环线程，可以在任意线程调用
+    virtual void Wakeup() = 0;
+
+    // 开始监听一个新连接上的请求
+    virtual void RegisterClient(HttpConnection &client) = 0;
+
+    // 关闭一个客户端的连接，从 I/O 后端中移除并调用客户端的 Close()
+    virtual void CloseConnection(HttpConnection &client) = 0;
+
+protected: // 事件循环线程调用的公共函数
+    // 下一次等待 I/O 的超时时间：处理超时连接，排空连接期间最多等待 DRAIN_CHECK_MS_
+    int GetNextTimeout();
+
+    // 开启 busy_poll 时，在阻塞等待之前反复调用 poll()（不阻塞地检查是否有新事件），最多 busy_poll_us 且不超过 timeout
+    // poll() 返回 true 时立即返回 true；轮询超时或未开启时返回 false，调用者再阻塞等待
+    template<typename Func>
+    bool BusyPoll(int timeout, Func &&poll);
+
+    // 每轮等待前调用：收到排空请求后停止监听，关闭空闲连接，所有连接关闭或超时后结束事件循环
+    void DealDrain();
+
+    // 通过 TCP_INFO 查看监听 socket 的全连接队列是否已满
+    bool IsAcceptQueueFull();
+
+    // 初始化一个 HttpConnection 对象，加入定时器并交给 I/O 后端；连接数已满时拒绝连接并返回 false
+    bool AddClient(int fd, const sockaddr_in &address);
+
+    // 按 option_.tcp 设置 accept 得到的 socket 的 TCP 参数
+    void SetClientOption(int fd);
+
+    // 定时器回调，连接在此期间已被关闭或 fd 已被复用时什么也不做；连接交给了线程池时只记下，任务完成后再关闭
+    void CloseExpired(int fd, uint32_t generation);
+
+    // 处理线程池任务的完成项之前调用：清除连接的忙碌标记，任务期间连接超时或排空到期时关闭连接并返回 false
+    bool EndTask(HttpConnection &client);
+
+    // 当跟客户端发生了活动后，更新客户端的超时时间
+    void UpdateClientTimeout(HttpConnection &client);
+
+    // 向还未初始化连接对象的客户端发送状态码为 code 的错误响应，然后关闭连接
+    void SendError(int fd, int code);
+
+    // 连接上读到了新的请求数据，记录请求开始的时间
+    void StartRequest(HttpConnection &client)
+    {
+        request_start_[client.GetFd()] = std::chrono::steady_clock::now();
+    }
+
+    // 响应发送完毕，统计请求延迟（可以在子线程中调用），流水线中一起发送的请求按同一个延迟统计
+    void FinishRequest(HttpConnection &client)
+    {
+        ServerStats::GetInstance()->RecordLatency(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - request_start_[client.GetFd()]).count(), std::max(client.GetResponseNum(), 1));
+    }
+
+protected:
+    int id_;                    // 事件循环编号
+
+    LoopOption option_;
+
+    int listen_fd_;
+
+    bool is_close_;
+
+    ThreadPool *thread_pool_;   // 所有事件循环共享的线程池，由 WebServer 持有
+
+    std::unique_ptr<HeapTimer> timer_;
+
+    ConnectionSlab *users_;     // 所有事件循环共享的连接数组，由 WebServer 持有，以 fd 为下标
+
+    std::vector<uint32_t> owned_;   // 以 fd 为下标，记录由本事件循环 accept 的连接的代数，0 表示不属于本事件循环
+
+    std::vector<std::chrono::steady_clock::time_point> request_start_;  // 以 fd 为下标，当前请求开始的时间
+
+    std::atomic<bool> drain_requested_;
+
+    bool is_draining_;
+
+    TimePoint drain_deadline_;
+
+    int node_;                  // 事件循环线程所在的 NUMA 节点，-1 表示未绑定或只有一个节点
+
+    static const int DRAIN_CHECK_MS_ = 100;
+
+private:
+    // 创建监听 socket，完成绑定和监听
+    bool CreateSocket();
+
+    // 在监听 socket 上试探内核是否支持 busy poll 相关的选项，不支持（或没有权限）时关闭对应的选项
+    void CheckBusyPollOption();
+
+    // 检查继承来的 fd 是否是监听同一端口的 socket，并设置为非阻塞
+    bool InheritSocket(int fd);
+
+    // 按 option_.tcp 设置监听 socket 的 TCP 参数，缓冲区大小会被 accept 得到的 socket 继承
+    bool SetListenOption();
+};
+
+template<typename Func>
+bool EventLoop::BusyPoll(int timeout, Func &&poll)
+{
+    if (option_.busy_poll_us <= 0 || timeout == 0)
+    {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::microseconds budget(option_.busy_poll_us);
+    if (timeout > 0)
+    {
+        budget = std::min<std::chrono::microseconds>(budget, std::chrono::milliseconds(timeout));
+    }
+    bool res = false;
+    auto now = start;
+    do
+    {
+        if (poll())
+        {
+            res = true;
+            break;
+        }
+        now = std::chrono::steady_clock::now();
+    } while (now - start < budget);
+    ServerStats *stats = ServerStats::GetInstance();
+    ++(res ? stats->busy_poll_hit : stats->busy_poll_miss);
+    stats->busy_poll_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return res;
+}
+
+#endif
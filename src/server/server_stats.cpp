@@ -0,0 +1,148 @@
+#include "server_stats.h"
+
+void ServerStats::Initialization(int interval)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    interval_ = interval;
+    last_report_ = std::chrono::steady_clock::now();
+    last_ = TakeSnapshot();
+    last_listen_overflows_ = ReadListenOverflows();
+}
+
+int ServerStats::GetNextTimeout()
+{
+    if (interval_ <= 0)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last_report_).count();
+    return static_cast<int>(std::max<long long>(interval_ - elapsed, 0));
+}
+
+void ServerStats::TryReport()
+{
+    if (interval_ <= 0)
+    {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_ms = std::chrono::duration<double, std::milli>(now - last_report_).count();
+    if (elapsed_ms < interval_)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> locker(mtx_);
+    Snapshot cur = TakeSnapshot();
+    uint64_t listen_overflows = ReadListenOverflows();
+    uint64_t accepts = cur.accept_count - last_.accept_count;
+    LOG_INFO("[stats] accept/s: %.1f, accept loop: %.3f ms (%.2f us/conn), batch full: %lu, queue full: %lu, "
+             "listen overflows: %lu, accept error: %lu, rejected: %lu",
+             accepts * 1000.0 / elapsed_ms, (cur.accept_loop_ns - last_.accept_loop_ns) / 1e6,
+             accepts ? (cur.accept_loop_ns - last_.accept_loop_ns) / 1e3 / accepts : 0.0,
+             accept_batch_full.load(), accept_queue_full.load(), listen_overflows - last_listen_overflows_,
+             accept_error.load(), reject_count.load());
+    uint64_t counts[LATENCY_BUCKETS_];
+    uint64_t requests = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS_; ++i)
+    {
+        uint64_t bucket = latency_buckets_[i].load(std::memory_order_relaxed);
+        counts[i] = bucket - last_latency_buckets_[i];
+        last_latency_buckets_[i] = bucket;
+        requests += counts[i];
+    }
+    if (requests > 0)
+    {
+        LOG_INFO("[stats] requests/s: %.1f, latency p50: %lu us, p99: %lu us, inline: %lu, pool: %lu, shed: %lu, cpu: %.1f%%",
+                 requests * 1000.0 / elapsed_ms, GetPercentile(counts, requests, 0.5),
+                 GetPercentile(counts, requests, 0.99), request_inline.load(), request_pool.load(), request_shed.load(),
+                 (cur.cpu_us - last_.cpu_us) / 10.0 / elapsed_ms);
+    }
+    uint64_t hit = cur.busy_poll_hit - last_.busy_poll_hit;
+    uint64_t miss = cur.busy_poll_miss - last_.busy_poll_miss;
+    if (hit + miss > 0)
+    {
+        // spin 为所有事件循环花在轮询上的时间占比（100% 相当于一个核），cpu 为整个进程的 CPU 占用
+        LOG_INFO("[stats] busy poll hit: %lu, miss: %lu (hit rate %.1f%%), spin: %.1f%%, cpu: %.1f%%", hit, miss,
+                 hit * 100.0 / (hit + miss), (cur.busy_poll_ns - last_.busy_poll_ns) / 1e4 / elapsed_ms,
+                 (cur.cpu_us - last_.cpu_us) / 10.0 / elapsed_ms);
+    }
+    uint64_t ctl = cur.epoll_ctl_count - last_.epoll_ctl_count;
+    uint64_t saved = cur.epoll_ctl_saved - last_.epoll_ctl_saved;
+    if (ctl + saved > 0)
+    {
+        LOG_INFO("[stats] epoll_ctl/s: %.1f, saved/s: %.1f", ctl * 1000.0 / elapsed_ms, saved * 1000.0 / elapsed_ms);
+    }
+    uint64_t cache_hit = cur.file_cache.hit - last_.file_cache.hit;
+    uint64_t cache_miss = cur.file_cache.miss - last_.file_cache.miss;
+    if (cache_hit + cache_miss > 0)
+    {
+        LOG_INFO("[stats] file cache hit/s: %.1f, miss/s: %.1f (hit rate %.1f%%), files: %zu, size: %.1f MB, "
+                 "invalidated: %lu, evicted: %lu", cache_hit * 1000.0 / elapsed_ms, cache_miss * 1000.0 / elapsed_ms,
+                 cache_hit * 100.0 / (cache_hit + cache_miss), cur.file_cache.entry_num, cur.file_cache.size / 1048576.0,
+                 cur.file_cache.invalidated, cur.file_cache.evicted);
+    }
+    last_ = cur;
+    last_listen_overflows_ = listen_overflows;
+    last_report_ = now;
+}
+
+uint64_t ServerStats::GetPercentile(const uint64_t *counts, uint64_t total, double percent)
+{
+    uint64_t target = static_cast<uint64_t>(total * percent), seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS_; ++i)
+    {
+        seen += counts[i];
+        if (seen > target)
+        {
+            return GetBucketUpperBound(i);
+        }
+    }
+    return GetBucketUpperBound(LATENCY_BUCKETS_ - 1);
+}
+
+uint64_t ServerStats::GetCpuTime()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == -1)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+uint64_t ServerStats::ReadListenOverflows()
+{
+    // 文件中 TcpExt 为两行，第一行是字段名，第二行是对应的值
+    FILE *fp = fopen("/proc/net/netstat", "r");
+    if (!fp)
+    {
+        return 0;
+    }
+    char names[8192], values[8192];
+    uint64_t res = 0;
+    while (fgets(names, sizeof(names), fp) && fgets(values, sizeof(values), fp))
+    {
+        if (strncmp(names, "TcpExt:", 7) != 0)
+        {
+            continue;
+        }
+        char *name_save = nullptr, *value_save = nullptr;
+        char *name = strtok_r(names, " \n", &name_save);
+        char *value = strtok_r(values, " \n", &value_save);
+        while (name && value)
+        {
+            if (strcmp(name, "ListenOverflows") == 0)
+            {
+                res = strtoull(value, nullptr, 10);
+                break;
+            }
+            name = strtok_r(nullptr, " \n", &name_save);
+            value = strtok_r(nullptr, " \n", &value_save);
+        }
+        break;
+    }
+    fclose(fp);
+    return res;
+}
@@ -0,0 +1,148 @@
+#ifndef SERVER_STATS_H
+#define SERVER_STATS_H
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <sys/resource.h>
+#include "../log/log.h"
+#include "../http/file_cache.h"
+
+// 服务器运行指标，所有事件循环共享同一份计数器（单例）
+// 计数器只做原子累加，由信号处理线程按 interval 周期性地计算速率并写入日志，不依赖事件循环是否有事件
+class ServerStats
+{
+public:
+    static ServerStats *GetInstance()
+    {
+        static ServerStats stats;
+        return &stats;
+    }
+
+    // interval 为打印指标的周期（ms），小于等于 0 表示不打印
+    void Initialization(int interval);
+
+    // 距上次打印超过 interval 时打印一次指标，由信号处理线程在等待超时后调用
+    void TryReport();
+
+    // 距下次打印还有多少毫秒，作为信号处理线程等待的超时时间；不打印时返回 -1（一直阻塞）
+    int GetNextTimeout();
+
+    // ========== accept 相关 ==========
+    std::atomic<uint64_t> accept_count{0};          // 成功 accept 的连接数
+
+    std::atomic<uint64_t> accept_loop_ns{0};        // 在 accept 循环中花费的总时间（ns）
+
+    std::atomic<uint64_t> accept_batch_full{0};     // 一次唤醒达到 accept_batch 上限、剩余连接留到下一轮的次数
+
+    std::atomic<uint64_t> accept_queue_full{0};     // 唤醒时观察到全连接队列已满（长度 >= backlog）的次数
+
+    std::atomic<uint64_t> accept_error{0};          // accept 失败（EMFILE、ENFILE 等，不含 EAGAIN）的次数
+
+    std::atomic<uint64_t> reject_count{0};          // 因连接数达到上限而拒绝的连接数
+
+    // ========== 请求处理相关 ==========
+    std::atomic<uint64_t> request_inline{0};        // 在事件循环线程直接处理的请求数
+
+    std::atomic<uint64_t> request_pool{0};          // 交给线程池处理的请求数
+
+    std::atomic<uint64_t> request_shed{0};          // 线程池过载时以 503 拒绝的请求数
+
+    // ========== epoll 后端 ==========
+    std::atomic<uint64_t> epoll_ctl_count{0};       // 实际调用 epoll_ctl 的次数
+
+    std::atomic<uint64_t> epoll_ctl_saved{0};       // 因事件未变化、已合并或 fd 已移除而省去的 epoll_ctl 次数
+
+    // ========== busy poll ==========
+    std::atomic<uint64_t> busy_poll_hit{0};         // 轮询期间等到了事件、不必阻塞的次数
+
+    std::atomic<uint64_t> busy_poll_miss{0};        // 轮询超时、仍需阻塞等待的次数
+
+    std::atomic<uint64_t> busy_poll_ns{0};          // 花在轮询上的总时间（ns）
+
+    // 记录 count 个请求从读到数据到响应发送完毕的时间（ns）
+    void RecordLatency(uint64_t ns, uint64_t count = 1)
+    {
+        latency_buckets_[GetLatencyBucket(ns / 1000)].fetch_add(count, std::memory_order_relaxed);
+    }
+
+private:
+    ServerStats() : interval_(0), last_listen_overflows_(0) {}
+
+    ~ServerStats() = default;
+
+    // 读取 /proc/net/netstat 中的 ListenOverflows（整个系统因全连接队列溢出而丢弃的连接数）
+    static uint64_t ReadListenOverflows();
+
+    // 进程至今使用的 CPU 时间（us，所有线程的用户态加内核态）
+    static uint64_t GetCpuTime();
+
+    static const size_t LATENCY_BUCKETS_ = 128;
+
+    // 延迟直方图：小于 4us 时每 1us 一个桶，之后每个 2 的幂区间再均分为 4 个桶（相对误差不超过 25%）
+    static size_t GetLatencyBucket(uint64_t us)
+    {
+        if (us < 4)
+        {
+            return us;
+        }
+        int msb = 63 - __builtin_clzll(us);
+        return std::min(LATENCY_BUCKETS_ - 1, static_cast<size_t>((msb - 1) * 4 + ((us >> (msb - 2)) & 3)));
+    }
+
+    // 桶 index 的上界（us）
+    static uint64_t GetBucketUpperBound(size_t index)
+    {
+        if (index < 4)
+        {
+            return index + 1;
+        }
+        int msb = static_cast<int>(index / 4) + 1;
+        return static_cast<uint64_t>(4 + index % 4 + 1) << (msb - 2);
+    }
+
+    // 计算本区间内延迟的百分位数（us），counts 为各桶的区间计数
+    static uint64_t GetPercentile(const uint64_t *counts, uint64_t total, double percent);
+
+    // 上次打印时各计数器的值，用于计算区间速率
+    struct Snapshot
+    {
+        uint64_t accept_count;
+        uint64_t accept_loop_ns;
+        uint64_t epoll_ctl_count;
+        uint64_t epoll_ctl_saved;
+        uint64_t busy_poll_hit;
+        uint64_t busy_poll_miss;
+        uint64_t busy_poll_ns;
+        uint64_t cpu_us;            // 进程的用户态和内核态 CPU 时间
+        FileCache::Stats file_cache;
+    };
+
+    // 读取各计数器当前的值
+    Snapshot TakeSnapshot()
+    {
+        return {accept_count, accept_loop_ns, epoll_ctl_count, epoll_ctl_saved,
+                busy_poll_hit, busy_poll_miss, busy_poll_ns, GetCpuTime(), FileCache::GetInstance()->GetStats()};
+    }
+
+    int interval_;
+
+    std::chrono::steady_clock::time_point last_report_;
+
+    Snapshot last_;
+
+    uint64_t last_listen_overflows_;
+
+    std::atomic<uint64_t> latency_buckets_[LATENCY_BUCKETS_] = {};
+
+    uint64_t last_latency_buckets_[LATENCY_BUCKETS_] = {};
+
+    std::mutex mtx_;
+};
+
+#endif
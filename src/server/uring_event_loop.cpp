@@ -0,0 +1,359 @@
+#include "uring_event_loop.h"
+
+UringEventLoop::UringEventLoop(int id, const LoopOption &option, ThreadPool *thread_pool, ConnectionSlab *users,
+                               std::unique_ptr<IoUring> ring) :
+        EventLoop(id, option, thread_pool, users), ring_(std::move(ring)),
+        notify_fd_(eventfd(0, EFD_CLOEXEC)), notify_value_(0), send_state_(users->Capacity())
+{
+    assert(ring_ && ring_->IsValid() && notify_fd_ >= 0);
+}
+
+UringEventLoop::~UringEventLoop()
+{
+    close(notify_fd_);
+}
+
+void UringEventLoop::Loop()
+{
+    // 由事件循环线程启用 io_uring，之后只有该线程提交请求
+    if (!ring_->Enable())
+    {
+        LOG_ERROR("Loop[%d] enable io_uring error!", id_);
+        return;
+    }
+    SubmitNotifyRead();
+    while (true)
+    {
+        DealDrain();
+        if (is_close_)
+        {
+            break;
+        }
+        // 上一轮处理完成项时准备的提交项在这里一次性提交，并等待新的完成项
+        // busy_poll：先提交，再在用户态轮询完成队列一段时间，没有新的完成项才进入内核等待
+        int timeout = GetNextTimeout();
+        int res = 0;
+        if (option_.busy_poll_us > 0)
+        {
+            res = ring_->SubmitAndWait(0);
+        }
+        if (res >= 0 && !BusyPoll(timeout, [this] { return ring_->HasCqe(); }))
+        {
+            res = ring_->SubmitAndWait(1, timeout);
+        }
+        if (res < 0)
+        {
+            LOG_ERROR("Loop[%d] io_uring_enter error: %s", id_, strerror(errno));
+        }
+        ring_->ForEachCqe([this](const struct io_uring_cqe &cqe) { HandleCqe(cqe); });
+    }
+}
+
+bool UringEventLoop::RegisterListen()
+{
+    // 内核对非阻塞的 socket 不会等待而是直接返回 EAGAIN，io_uring 管理的 socket 保持阻塞模式
+    if (fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) & ~O_NONBLOCK) == -1)
+    {
+        return false;
+    }
+    SubmitAccept();
+    return true;
+}
+
+void UringEventLoop::RegisterClient(HttpConnection &client)
+{
+    send_state_[client.GetFd()] = SendState{};
+    SubmitRecv(client);
+}
+
+void UringEventLoop::StopListen()
+{
+    // 取消 multishot accept 后关闭监听 socket，关闭 fd 本身不会结束已提交的 accept
+    struct io_uring_sqe *sqe = ring_->GetSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = EncodeData(OP_ACCEPT, listen_fd_, 0);
+    sqe->user_data = EncodeData(OP_CANCEL, listen_fd_, 0);
+    ring_->SubmitAndWait(0);
+    close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void UringEventLoop::Wakeup()
+{
+    // 和子线程的通知共用 eventfd，OnNotify() 之后回到 Loop() 检查排空请求
+    uint64_t one = 1;
+    if (write(notify_fd_, &one, sizeof(one)) != sizeof(one))
+    {
+        LOG_ERROR("Loop[%d] wakeup error!", id_);
+    }
+}
+
+void UringEventLoop::CloseConnection(HttpConnection &client)
+{
+    assert(client.GetFd() > 0);
+    LOG_INFO("Client[%d] quit!", client.GetFd());
+    // 关闭前先 shutdown，让还未完成的 recv/send 尽快以错误结束（它们的完成项会因代数不匹配被忽略）
+    shutdown(client.GetFd(), SHUT_RDWR);
+    client.Close();
+}
+
+void UringEventLoop::SubmitAccept()
+{
+    struct io_uring_sqe *sqe = ring_->GetSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = EncodeData(OP_ACCEPT, listen_fd_, 0);
+}
+
+void UringEventLoop::SubmitRecv(HttpConnection &client)
+{
+    // 没有未处理完的请求数据时连接是空闲的，排空时可以直接关闭
+    client.SetIdle(!client.HasPendingInput());
+    struct io_uring_sqe *sqe = ring_->GetSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client.GetFd();
+    // 不指定缓冲区，由内核在数据到达时从缓冲区组中挑选一个
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = ring_->GetBufferGroup();
+    sqe->len = ring_->GetBufferSize();
+    sqe->user_data = EncodeData(OP_RECV, client.GetFd(), client.GetGeneration());
+}
+
+void UringEventLoop::SubmitSend(HttpConnection &client)
+{
+    int fd = client.GetFd();
+    if (client.GetToWriteBytes() == 0)
+    {
+        AfterWrite(client);
+        return;
+    }
+    // 整条响应链（可能包含流水线中的多个响应）用一个 sendmsg 发送，msghdr 在发送完成前必须有效，因此保存在发送状态中
+    SendState &state = send_state_[fd];
+    state = SendState{};
+    state.msg.msg_iov = const_cast<struct iovec *>(client.GetIov()); // sendmsg 不会修改 iovec
+    state.msg.msg_iovlen = std::min(client.GetIovNum(), IOV_MAX);
+    state.in_flight = true;
+    struct io_uring_sqe *sqe = ring_->GetSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long long>(&state.msg);
+    sqe->len = 1;
+    // MSG_WAITALL 让内核在部分发送时继续发送剩余部分
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    sqe->user_data = EncodeData(OP_SEND, fd, client.GetGeneration());
+}
+
+void UringEventLoop::SubmitNotifyRead()
+{
+    struct io_uring_sqe *sqe = ring_->GetSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = notify_fd_;
+    sqe->addr = reinterpret_cast<unsigned long long>(&notify_value_);
+    sqe->len = sizeof(notify_value_);
+    sqe->user_data = EncodeData(OP_NOTIFY, notify_fd_, 0);
+}
+
+void UringEventLoop::HandleCqe(const struct io_uring_cqe &cqe)
+{
+    Operation op = static_cast<Operation>(cqe.user_data >> 56);
+    int fd = static_cast<int>((cqe.user_data >> 32) & 0xFFFFFF);
+    uint32_t generation = static_cast<uint32_t>(cqe.user_data);
+    switch (op)
+    {
+        case OP_ACCEPT:
+            OnAccept(cqe.res, cqe.flags);
+            break;
+        case OP_RECV:
+            OnRecv(fd, generation, cqe.res, cqe.flags);
+            break;
+        case OP_SEND:
+            OnSend(fd, generation, cqe.res);
+            break;
+        case OP_NOTIFY:
+            OnNotify();
+            break;
+        case OP_CANCEL:
+            break;
+        default:
+            LOG_ERROR("Unexpected io_uring completion");
+            break;
+    }
+}
+
+void UringEventLoop::OnAccept(int res, uint32_t flags)
+{
+    ServerStats *stats = ServerStats::GetInstance();
+    if (res >= 0)
+    {
+        struct sockaddr_in client_address;
+        socklen_t len = sizeof(client_address);
+        memset(&client_address, 0, sizeof(client_address));
+        getpeername(res, (struct sockaddr *)&client_address, &len);
+        stats->accept_count++;
+        AddClient(res, client_address);
+    }
+    else if (res != -ECANCELED)
+    {
+        stats->accept_error++;
+        LOG_WARN("Loop[%d] accept error: %s", id_, strerror(-res));
+    }
+    // 没有 IORING_CQE_F_MORE 表示 multishot accept 已经结束，需要重新提交
+    if (!(flags & IORING_CQE_F_MORE) && !is_close_ && !is_draining_)
+    {
+        SubmitAccept();
+    }
+}
+
+void UringEventLoop::OnRecv(int fd, uint32_t generation, int res, uint32_t flags)
+{
+    HttpConnection *client = users_->Get(fd, generation);
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (client && res > 0)
+        {
+            client->AppendReadData(ring_->GetBuffer(bid), static_cast<size_t>(res));
+        }
+        // 数据已经拷贝到连接的读缓冲区，立刻把接收缓冲区还给内核
+        ring_->RecycleBuffer(bid);
+    }
+    if (!client)
+    {
+        return; // 连接已经关闭
+    }
+    if (res == -ENOBUFS)
+    {
+        // 接收缓冲区暂时用完了，重新提交
+        SubmitRecv(*client);
+        return;
+    }
+    if (res <= 0)
+    {
+        CloseConnection(*client);
+        return;
+    }
+    client->SetIdle(false);
+    UpdateClientTimeout(*client);
+    DispatchRequest(*client);
+}
+
+void UringEventLoop::OnSend(int fd, uint32_t generation, int res)
+{
+    HttpConnection *client = users_->Get(fd, generation);
+    if (!client)
+    {
+        return;
+    }
+    send_state_[fd].in_flight = false;
+    if (res < 0 && res != -EAGAIN && res != -EINTR)
+    {
+        CloseConnection(*client);
+        return;
+    }
+    if (res > 0)
+    {
+        client->Advance(static_cast<size_t>(res));
+    }
+    if (client->GetToWriteBytes() > 0)
+    {
+        SubmitSend(*client); // 部分发送或超过 IOV_MAX 个 iovec，继续发送剩余部分
+    }
+    else
+    {
+        AfterWrite(*client);
+    }
+}
+
+void UringEventLoop::OnNotify()
+{
+    // eventfd 的计数已被这次读请求清零，之后的 Push 会再次唤醒
+    completions_.TakeAll(batch_);
+    for (const Completion &completion : batch_)
+    {
+        HttpConnection *client = users_->Get(completion.fd, completion.generation);
+        if (client && EndTask(*client))
+        {
+            OnProcessed(*client, completion.has_response);
+        }
+    }
+    SubmitNotifyRead();
+}
+
+void UringEventLoop::DispatchRequest(HttpConnection &client)
+{
+    StartRequest(client);
+    if (option_.inline_fast_path)
+    {
+        // 停在需要交给线程池的请求上并且没有可以先发送的响应时才交给线程池，否则先发送，发送完毕后再次分派
+        bool has_response = client.Process(true);
+        if (has_response || !client.HasDeferredRequest())
+        {
+            ServerStats::GetInstance()->request_inline += has_response ? client.GetResponseNum() : 0;
+            OnProcessed(client, has_response);
+            return;
+        }
+    }
+    if (!thread_pool_->TryAddTask(std::bind(&UringEventLoop::ProcessTask, this, client.GetFd(), client.GetGeneration())))
+    {
+        // 线程池过载，回复 503，发送完毕后由 AfterWrite() 关闭连接
+        ServerStats::GetInstance()->request_shed++;
+        client.MakeErrorResponse(503, option_.retry_after);
+        SubmitSend(client);
+        return;
+    }
+    client.SetBusy(true);
+    ServerStats::GetInstance()->request_pool++;
+}
+
+void UringEventLoop::OnProcessed(HttpConnection &client, bool has_response)
+{
+    if (has_response)
+    {
+        SubmitSend(client);
+    }
+    else
+    {
+        SubmitRecv(client); // 请求还不完整，继续接收
+    }
+}
+
+void UringEventLoop::AfterWrite(HttpConnection &client)
+{
+    FinishRequest(client);
+    UpdateClientTimeout(client);
+    if (!client.IsKeepAlive())
+    {
+        CloseConnection(client);
+    }
+    else if (client.HasPendingInput())
+    {
+        // 读缓冲区中还有下一个请求
+        DispatchRequest(client);
+    }
+    else
+    {
+        SubmitRecv(client);
+    }
+}
+
+void UringEventLoop::ProcessTask(int fd, uint32_t generation)
+{
+    HttpConnection *client = users_->Get(fd, generation);
+    if (!client)
+    {
+        return;
+    }
+    bool has_response = client->Process();
+    if (completions_.Push({fd, generation, has_response}))
+    {
+        Wakeup();
+    }
+}
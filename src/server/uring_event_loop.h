@@ -0,0 +1,124 @@
+#ifndef URING_EVENT_LOOP_H
+#define URING_EVENT_LOOP_H
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <vector>
+#include "event_loop.h"
+#include "completion_queue.h"
+#include "../uring/uring.h"
+
+// 基于 io_uring 的事件循环：由内核完成 accept、recv 和 send，事件循环只处理完成项
+// - 监听 socket 上提交一次 multishot accept，之后每个新连接产生一个完成项
+// - recv 使用内核挑选的接收缓冲区 (provided buffer ring)，连接空闲时不占用缓冲区
+// - 一条响应链（响应头和文件内容，流水线请求时包含多个响应）用一个 sendmsg 发送
+// 请求的解析和响应的生成仍交给线程池，子线程处理完后通过 eventfd 通知事件循环提交发送
+class UringEventLoop : public EventLoop
+{
+public:
+    // ring 由 EventLoop::Create() 创建，已经注册好接收缓冲区
+    UringEventLoop(int id, const LoopOption &option, ThreadPool *thread_pool, ConnectionSlab *users,
+                   std::unique_ptr<IoUring> ring);
+
+    ~UringEventLoop() override;
+
+    // 提交请求并等待完成项，直到事件循环被关闭
+    void Loop() override;
+
+    const char *GetBackendName() const override
+    {
+        return "io_uring";
+    }
+
+protected:
+    bool RegisterListen() override;
+
+    void RegisterClient(HttpConnection &client) override;
+
+    void StopListen() override;
+
+    void Wakeup() override;
+
+    void CloseConnection(HttpConnection &client) override;
+
+private:
+    // 完成项的 user_data 中保存的操作类型
+    enum Operation : uint8_t
+    {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_SEND,
+        OP_NOTIFY,
+        OP_CANCEL,
+    };
+
+    // 子线程处理完一个请求后交给事件循环的结果
+    struct Completion
+    {
+        int fd;
+        uint32_t generation;
+        bool has_response;  // 是否生成了响应，否则需要继续接收数据
+    };
+
+    // 每个连接在事件循环中的发送状态，以 fd 为下标
+    struct SendState
+    {
+        bool in_flight;         // 是否有尚未完成的 sendmsg
+        struct msghdr msg;      // 正在发送的 sendmsg 的参数
+    };
+
+    // user_data 的格式：操作类型 (8 位) | fd (24 位) | 连接的代数 (32 位)
+    static uint64_t EncodeData(Operation op, int fd, uint32_t generation)
+    {
+        return (static_cast<uint64_t>(op) << 56) | (static_cast<uint64_t>(fd & 0xFFFFFF) << 32) | generation;
+    }
+
+    void SubmitAccept();
+
+    void SubmitRecv(HttpConnection &client);
+
+    void SubmitSend(HttpConnection &client);
+
+    // 在 eventfd 上提交一个读请求，等待子线程的通知
+    void SubmitNotifyRead();
+
+    void HandleCqe(const struct io_uring_cqe &cqe);
+
+    void OnAccept(int res, uint32_t flags);
+
+    void OnRecv(int fd, uint32_t generation, int res, uint32_t flags);
+
+    void OnSend(int fd, uint32_t generation, int res);
+
+    // 取出子线程处理完的请求，提交发送或继续接收
+    void OnNotify();
+
+    // 处理读缓冲区中的请求：开启 inline_fast_path 时不访问数据库的请求直接在事件循环线程处理，其余交给线程池
+    // 线程池过载时回复 503
+    void DispatchRequest(HttpConnection &client);
+
+    // 请求处理完毕：生成了响应则提交发送，否则继续接收
+    void OnProcessed(HttpConnection &client, bool has_response);
+
+    // 一个响应全部发送完毕：长连接继续处理或接收下一个请求，否则关闭连接
+    void AfterWrite(HttpConnection &client);
+
+private: // 子线程调用的函数
+    // 调用 HttpConnection 的 Process，解析请求并生成响应，然后通知事件循环
+    void ProcessTask(int fd, uint32_t generation);
+
+private:
+    std::unique_ptr<IoUring> ring_;
+
+    int notify_fd_;                     // 子线程通知事件循环的 eventfd
+
+    uint64_t notify_value_;             // eventfd 读请求的目标
+
+    CompletionQueue<Completion> completions_;
+
+    std::vector<Completion> batch_;     // 事件循环线程一次取出的完成项
+
+    std::vector<SendState> send_state_;
+};
+
+#endif
@@ -1,10 +1,19 @@
 #include "webserver.h"
 
+extern char **environ;
+
+int WebServer::signal_pipe_[2] = {-1, -1};
+
 WebServer::WebServer(const Json &config) :
-        port_(config["Server"]["port"]), listen_fd_(-1), timeout_MS_(config["Server"]["timeout"]), is_close_(false), 
-        open_linger_(config["Server"]["open_linger"]), resource_dir_(""), listen_event_(0), 
-        connection_event_(0), thread_pool_(std::make_unique<ThreadPool>(static_cast<size_t>(config["ThreadPool"]["thread_num"].AsInt()))),
-        epoller_(std::make_unique<Epoller>()), timer_(std::make_unique<HeapTimer>())
+        is_close_(false), reactor_num_(config["Server"]["reactor_num"].IsInt() ? config["Server"]["reactor_num"].AsInt() : 1),
+        io_backend_(config["Server"]["io_backend"].IsString() ? config["Server"]["io_backend"].AsString() : "epoll"),
+        resource_dir_(""), thread_pool_(std::make_unique<ThreadPool>(static_cast<size_t>(config["ThreadPool"]["thread_num"].AsInt()),
+            config["ThreadPool"]["target_delay"].IsInt() ? config["ThreadPool"]["target_delay"].AsInt() : 0,
+            config["ThreadPool"]["interval"].IsInt() ? config["ThreadPool"]["interval"].AsInt() : 100,
+            config["ThreadPool"]["max_queue_size"].IsInt() ? static_cast<size_t>(config["ThreadPool"]["max_queue_size"].AsInt()) : 0)),
+        users_(std::make_unique<ConnectionSlab>(config["Server"]["max_connection"].IsInt() ?
+                                                static_cast<size_t>(config["Server"]["max_connection"].AsInt()) : MAX_FD_)),
+        is_upgrading_(false)
 {
     std::string tmp = getcwd(nullptr, 256);
     size_t end = tmp.find("/src");
@@ -18,8 +27,42 @@ WebServer::WebServer(const Json &config) :
         Log::GetInstance()->Initialization(config["Log"]["log_level"], "./log", ".log", config["Log"]["block_queue_size"]);
     }
     MysqlConnectionPool::GetInstance();
+    if (reactor_num_ <= 0)
+    {
+        // 0 或负数表示按 CPU 核数创建事件循环
+        reactor_num_ = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    loop_option_.port = config["Server"]["port"];
+    loop_option_.timeout_MS = config["Server"]["timeout"];
+    loop_option_.open_linger = config["Server"]["open_linger"];
+    loop_option_.reuse_port = reactor_num_ > 1;
+    loop_option_.backlog = config["Server"]["backlog"].IsInt() ? config["Server"]["backlog"].AsInt() : 1024;
+    loop_option_.accept_batch = config["Server"]["accept_batch"].IsInt() ? std::max(1, config["Server"]["accept_batch"].AsInt()) : 64;
+    Json &tcp = config["Server"]["tcp"];
+    loop_option_.tcp.nodelay = tcp["nodelay"].IsBool() && tcp["nodelay"].AsBool();
+    loop_option_.tcp.cork = tcp["cork"].IsBool() && tcp["cork"].AsBool();
+    loop_option_.tcp.defer_accept = tcp["defer_accept"].IsInt() ? tcp["defer_accept"].AsInt() : 0;
+    loop_option_.tcp.fastopen = tcp["fastopen"].IsInt() ? tcp["fastopen"].AsInt() : 0;
+    loop_option_.tcp.sndbuf = tcp["sndbuf"].IsInt() ? tcp["sndbuf"].AsInt() : 0;
+    loop_option_.tcp.rcvbuf = tcp["rcvbuf"].IsInt() ? tcp["rcvbuf"].AsInt() : 0;
+    Json &uring = config["Server"]["io_uring"];
+    loop_option_.uring_entries = uring["entries"].IsInt() ? uring["entries"].AsInt() : 4096;
+    loop_option_.uring_buffer_num = uring["buffer_num"].IsInt() ? uring["buffer_num"].AsInt() : 4096;
+    loop_option_.uring_buffer_size = uring["buffer_size"].IsInt() ? uring["buffer_size"].AsInt() : 4096;
+    loop_option_.inline_fast_path = config["Server"]["inline_fast_path"].IsBool() && config["Server"]["inline_fast_path"].AsBool();
+    loop_option_.retry_after = config["Server"]["retry_after"].IsInt() ? config["Server"]["retry_after"].AsInt() : 1;
+    Json &busy_poll = config["Server"]["busy_poll"];
+    loop_option_.busy_poll_us = busy_poll["spin_us"].IsInt() ? busy_poll["spin_us"].AsInt() : 0;
+    loop_option_.socket_busy_poll_us = busy_poll["socket_us"].IsInt() ? busy_poll["socket_us"].AsInt() : 0;
+    loop_option_.prefer_busy_poll = busy_poll["prefer"].IsBool() && busy_poll["prefer"].AsBool();
+    loop_option_.drain_timeout_MS = config["Server"]["drain_timeout"].IsInt() ? config["Server"]["drain_timeout"].AsInt() : 30000;
+    ServerStats::GetInstance()->Initialization(config["Server"]["stats_interval"].IsInt() ? config["Server"]["stats_interval"].AsInt() : 0);
     InitEventMode(config["Server"]["ET_mode"]);
-    if (!InitSocket()) 
+    InitFileCache(config["Http"]["file_cache"]);
+    InitSendMode(config["Http"]);
+    InitAffinity(config["Server"]["affinity"]);
+    InitHttpTables(config["Http"]);
+    if (!InitEventLoops() || !InitSignal())
     {
         is_close_ = true;
     }
@@ -34,8 +77,36 @@ WebServer::WebServer(const Json &config) :
         else
         {
             LOG_INFO("========== Server initialization ==========");
-            LOG_INFO("Port: %d, OpenLinger: %s", port_, open_linger_? "true" : "false");
-            LOG_INFO("Listen Mode: %s, OpenConn Mode: %s", (listen_event_ & EPOLLET ? "ET": "LT"), (connection_event_ & EPOLLET ? "ET": "LT"));
+            LOG_INFO("Port: %d, OpenLinger: %s", loop_option_.port, loop_option_.open_linger ? "true" : "false");
+            LOG_INFO("Listen Mode: %s, OpenConn Mode: %s", (loop_option_.listen_event & EPOLLET ? "ET": "LT"),
+                                                           (loop_option_.connection_event & EPOLLET ? "ET": "LT"));
+            LOG_INFO("Reactor number: %d, IO backend: %s, Max connection: %zu, Inline fast path: %s", reactor_num_,
+                     loops_[0]->GetBackendName(), users_->Capacity(), loop_option_.inline_fast_path ? "true" : "false");
+            LOG_INFO("HTTP scanner: %s, routes: %zu, MIME types: %zu", HttpScanner::GetImplName(),
+                     HttpRequest::GetRouteNum(), HttpResponse::GetSuffixTypeNum());
+            LOG_INFO("File cache capacity: %zu bytes, max file size: %zu bytes, sendfile min size: %zu bytes",
+                     FileCache::GetInstance()->GetCapacity(), FileCache::GetInstance()->GetMaxFileSize(),
+                     FileCache::GetInstance()->GetSendfileMinSize());
+            LOG_INFO("TCP nodelay: %s, cork: %s, defer accept: %d s, fastopen: %d, sndbuf: %d, rcvbuf: %d",
+                     loop_option_.tcp.nodelay ? "true" : "false", loop_option_.tcp.cork ? "true" : "false",
+                     loop_option_.tcp.defer_accept, loop_option_.tcp.fastopen, loop_option_.tcp.sndbuf, loop_option_.tcp.rcvbuf);
+            LOG_INFO("Busy poll spin: %d us, SO_BUSY_POLL: %d us, SO_PREFER_BUSY_POLL: %s", loop_option_.busy_poll_us,
+                     loop_option_.socket_busy_poll_us, loop_option_.prefer_busy_poll ? "true" : "false");
+            LOG_INFO("Backlog: %d, Accept batch: %d, Drain timeout: %d", loop_option_.backlog, loop_option_.accept_batch,
+                     loop_option_.drain_timeout_MS);
+            LOG_INFO("ThreadPool target delay: %d ms, interval: %d ms, max queue size: %d",
+                     config["ThreadPool"]["target_delay"].IsInt() ? config["ThreadPool"]["target_delay"].AsInt() : 0,
+                     config["ThreadPool"]["interval"].IsInt() ? config["ThreadPool"]["interval"].AsInt() : 100,
+                     config["ThreadPool"]["max_queue_size"].IsInt() ? config["ThreadPool"]["max_queue_size"].AsInt() : 0);
+            LOG_INFO("CPU topology: %s", CpuTopology::GetInstance()->Describe().c_str());
+            for (int i = 0; i < reactor_num_ && !reactor_cpus_.empty(); ++i)
+            {
+                std::vector<int> cpus = GetReactorCpus(i);
+                LOG_INFO("Loop[%d] affinity: cpu %d (node %d)", i, cpus[0], CpuTopology::GetInstance()->GetNodeOfCpu(cpus[0]));
+            }
+            LOG_INFO("ThreadPool affinity: %s, background affinity: %s",
+                     worker_cpus_.empty() ? "none" : CpuTopology::FormatCpuList(worker_cpus_).c_str(),
+                     background_cpus_.empty() ? "none" : CpuTopology::FormatCpuList(background_cpus_).c_str());
             LOG_INFO("Log level: %d", config["Log"]["log_level"]);
             LOG_INFO("ResourceDir: %s", HttpConnection::resource_dir_.c_str());
             LOG_INFO("MySql connect database : %s", MysqlConnectionPool::GetInstance()->GetDatabaseName().c_str());
@@ -45,55 +116,66 @@ WebServer::WebServer(const Json &config) :
 
 WebServer::~WebServer()
 {
-    close(listen_fd_);
     is_close_ = true;
+    for (auto &t : loop_threads_)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    if (signal_thread_.joinable())
+    {
+        // 写入 0 通知信号处理线程退出
+        char exit_sig = 0;
+        if (write(signal_pipe_[1], &exit_sig, 1) == 1)
+        {
+            signal_thread_.join();
+        }
+        else
+        {
+            signal_thread_.detach();
+        }
+    }
+    loops_.clear();
     MysqlConnectionPool::GetInstance()->CloseMysqlConnectionPool();
 }
 
 void WebServer::Start()
 {
-    int timeout = -1; // 默认epoll_wait 阻塞
-    if (!is_close_)
+    if (is_close_)
     {
-        LOG_INFO("========== Start Server ==========");
+        return;
     }
-    while (!is_close_)
+    LOG_INFO("========== Start Server ==========");
+    signal_thread_ = std::thread(&WebServer::DealSignal, this);
+    CpuTopology::Bind(signal_thread_.native_handle(), background_cpus_);
+    // 由旧进程升级而来时，初始化完成后通知旧进程排空连接并退出
+    const char *parent = getenv("WEBSERVER_UPGRADE_PARENT");
+    if (parent && atoi(parent) == getppid())
     {
-        // 断开超时的连接，设置 epoll_wait() 的阻塞时间为最早的未超时节点到超时需要的时间
-        if (timeout_MS_ > 0) 
-        {
-            timeout = timer_->GetNextTimeout();
-        }
-        int event_number = epoller_->Wait(timeout);
-        for (int i = 0; i < event_number; ++i)
+        LOG_INFO("Upgrade from process %d finished, notify it to drain", getppid());
+        kill(getppid(), SIGTERM);
+    }
+    unsetenv("WEBSERVER_UPGRADE_PARENT");
+    // 1 ~ n-1 号事件循环运行在各自的线程中，0 号事件循环直接运行在主线程
+    // 事件循环线程先绑定 CPU 再开始 accept，连接的缓冲区才能分配在事件循环所在的节点上
+    for (size_t i = 1; i < loops_.size(); ++i)
+    {
+        loop_threads_.emplace_back([this, i]
         {
-            int fd = epoller_->GetEventFd(i);
-            uint32_t event = epoller_->GetEvents(i);
-            if (fd == listen_fd_)
-            {
-                DealListen();
-            }
-            else if (event & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
-            {
-                assert(users_.count(fd) > 0);
-                CloseConnection(users_[fd]);
-            }
-            else if (event & EPOLLIN)
-            {
-                assert(users_.count(fd) > 0);
-                DealRead(users_[fd]);
-            }
-            else if (event & EPOLLOUT)
-            {
-                assert(users_.count(fd) > 0);
-                DealWrite(users_[fd]);
-            }
-            else
-            {
-                LOG_ERROR("Unexpected event");
-            }
-        }
+            loops_[i]->BindThread(GetReactorCpus(static_cast<int>(i)));
+            loops_[i]->Loop();
+        });
     }
+    loops_[0]->BindThread(GetReactorCpus(0));
+    loops_[0]->Loop();
+    for (auto &t : loop_threads_)
+    {
+        t.join();
+    }
+    loop_threads_.clear();
+    LOG_INFO("========== Server stopped ==========");
 }
 
 void WebServer::InitEventMode(int trigger_mode)
@@ -102,225 +184,356 @@ void WebServer::InitEventMode(int trigger_mode)
     // EPOLLHUP 表示发生了挂起事件，通常与文件描述符相关的异常情况有关，如管道破裂、连接被重置等
     // EPOLLERR 表示发生了错误事件，通常表示出现了与文件描述符相关的错误，如连接错误、I/O 错误等
     // EPOLLONESHOT 表示注册的文件描述符只能触发一次事件，触发后需要重新设置才能继续触发。这可以用于实现一次性的事件处理
-    listen_event_ = EPOLLRDHUP | EPOLLHUP | EPOLLERR;
-    connection_event_ = EPOLLONESHOT | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
+    uint32_t listen_event = EPOLLRDHUP | EPOLLHUP | EPOLLERR;
+    uint32_t connection_event = EPOLLONESHOT | EPOLLRDHUP | EPOLLHUP | EPOLLERR;
     switch (trigger_mode)
     {
         case 0:
             break;
         case 1:
-            connection_event_ |= EPOLLET;
+            connection_event |= EPOLLET;
             break;
         case 2:
-            listen_event_ |= EPOLLET;
+            listen_event |= EPOLLET;
             break;
         case 3:
         default:
-            listen_event_ |= EPOLLET;
-            connection_event_ |= EPOLLET;
+            listen_event |= EPOLLET;
+            connection_event |= EPOLLET;
             break;
     }
-    HttpConnection::is_ET_mode_ = connection_event_ & EPOLLET;
+    loop_option_.listen_event = listen_event;
+    loop_option_.connection_event = connection_event;
+    HttpConnection::is_ET_mode_ = connection_event & EPOLLET;
 }
 
-bool WebServer::InitSocket()
+void WebServer::InitAffinity(Json &affinity)
 {
-    if (port_ > 65535 || port_ < 1024)
+    reactor_cpus_ = CpuTopology::ParseCpuList(affinity["reactor"].IsString() ? affinity["reactor"].AsString() : "");
+    worker_cpus_ = CpuTopology::ParseCpuList(affinity["worker"].IsString() ? affinity["worker"].AsString() : "");
+    background_cpus_ = CpuTopology::ParseCpuList(affinity["background"].IsString() ? affinity["background"].AsString() : "");
+    // 线程池、日志、数据库连接池和文件缓存的线程在此之前已经启动，通过句柄设置亲和性
+    for (auto thread : thread_pool_->GetThreads())
     {
-        LOG_ERROR("Port: %d error!",  port_);
-        return false;
+        if (!CpuTopology::Bind(thread, worker_cpus_))
+        {
+            LOG_WARN("ThreadPool bind to cpu %s error!", CpuTopology::FormatCpuList(worker_cpus_).c_str());
+            break;
+        }
     }
-
-    if ((listen_fd_ = socket(PF_INET, SOCK_STREAM, 0)) == -1)
+    std::vector<std::thread::native_handle_type> background = MysqlConnectionPool::GetInstance()->GetThreads();
+    if (Log::GetInstance()->GetWriteThread())
     {
-        LOG_ERROR("Create socket error!");
-        return false;
+        background.push_back(Log::GetInstance()->GetWriteThread()->native_handle());
     }
-
-    // 根据参数设置是否优雅关闭，设置超时时间为 1s
-    struct linger opt_linger = {0};
-    if (open_linger_)
+    if (FileCache::GetInstance()->GetWatchThread())
     {
-        opt_linger.l_onoff = 1;
-        opt_linger.l_linger = 1;
+        background.push_back(FileCache::GetInstance()->GetWatchThread()->native_handle());
     }
-    if (setsockopt(listen_fd_, SOL_SOCKET, SO_LINGER, &opt_linger, sizeof(opt_linger)) == -1)
+    for (auto thread : background)
     {
-        LOG_ERROR("Init linger error!");
-        close(listen_fd_);
-        return false;
+        if (!CpuTopology::Bind(thread, background_cpus_))
+        {
+            LOG_WARN("Background thread bind to cpu %s error!", CpuTopology::FormatCpuList(background_cpus_).c_str());
+            break;
+        }
     }
+}
 
-    // 设置端口复用
-    int reuse = 1;
-    if ((setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse))) == -1)
+void WebServer::InitHttpTables(Json &http)
+{
+    if (http["routes"].IsObject() && !HttpRequest::AddRoutes(GetStringPairs(http["routes"])))
     {
-        LOG_ERROR("set socket setsockopt error !");
-        close(listen_fd_);
-        return false;
+        LOG_ERROR("Http.routes: too many routes or no perfect hash, use the default routes");
     }
-
-    struct sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = htons(port_);
-    if (bind(listen_fd_, (struct sockaddr *)&address, sizeof(address)) == -1)
-    {
-        LOG_ERROR("Bind Port: %d error!", port_);
-        close(listen_fd_);
-        return false;
-    }
-
-    if (listen(listen_fd_, 5) == -1)
+    if (http["mime_types"].IsObject() && !HttpResponse::AddSuffixTypes(GetStringPairs(http["mime_types"])))
     {
-        LOG_ERROR("Listen port: %d error!", port_);
-        close(listen_fd_);
-        return false;
+        LOG_ERROR("Http.mime_types: too many types or no perfect hash, use the default types");
     }
+}
+
+void WebServer::InitFileCache(Json &file_cache)
+{
+    size_t capacity = file_cache["capacity"].IsInt() ? static_cast<size_t>(std::max(0, file_cache["capacity"].AsInt())) : 64 << 20;
+    size_t max_file_size = file_cache["max_file_size"].IsInt() ? static_cast<size_t>(std::max(0, file_cache["max_file_size"].AsInt())) : 8 << 20;
+    FileCache::GetInstance()->Initialization(resource_dir_, capacity, max_file_size);
+}
 
-    if (!epoller_->AddFd(listen_fd_, listen_event_ | EPOLLIN))
+void WebServer::InitSendMode(Json &http)
+{
+    std::string mode = http["send_mode"].IsString() ? http["send_mode"].AsString() : "mmap";
+    if (mode != "sendfile")
     {
-        LOG_ERROR("Add listen error!");
-        close(listen_fd_);
-        return false;
+        if (mode != "mmap")
+        {
+            LOG_WARN("Unknown send mode %s, use mmap", mode.c_str());
+        }
+        return;
     }
-
-    if (!SetNonblock(listen_fd_))
+    // io_uring 后端用一个 sendmsg 发送整条 iovec 链，没有对应 sendfile() 的操作，仍然映射文件
+    if (io_backend_ != "epoll")
     {
-        LOG_ERROR("Set File Nonblock failed!");
+        LOG_WARN("Send mode sendfile is only supported by the epoll backend, use mmap");
+        return;
     }
-    LOG_INFO("Init Socket Success! listen fd : %d", listen_fd_);
-    return true;
+    size_t min_size = http["sendfile_min_size"].IsInt() ? static_cast<size_t>(std::max(1, http["sendfile_min_size"].AsInt())) : 64 << 10;
+    FileCache::GetInstance()->SetSendfileMinSize(min_size);
 }
 
-void WebServer::DealListen()
+std::vector<std::pair<std::string, std::string>> WebServer::GetStringPairs(Json &object)
 {
-    struct sockaddr_in client_address;
-    socklen_t len = sizeof(client_address);
-    // 若监听事件设为了 ET 模式，需要一次性处理所有连接的请求（do while）
-    do
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (auto &item : object.AsObject())
     {
-        int fd = accept(listen_fd_, (struct sockaddr *)&client_address, &len);
-        if (fd < 0)
+        if (item.second.IsString())
         {
-            return;
+            pairs.emplace_back(item.first, item.second.AsString());
         }
-        else if (HttpConnection::http_connection_numner_ >= MAX_FD_)
+        else
         {
-            SendError(fd, "Server is busy now!");
-            LOG_WARN("Clients is full!");
-            return;
+            LOG_WARN("Ignore non-string value of %s", item.first.c_str());
         }
-        AddClient(fd, client_address);
-    } while (listen_event_ & EPOLLET);
+    }
+    return pairs;
 }
 
-void WebServer::AddClient(int fd, const sockaddr_in &address)
+std::vector<int> WebServer::GetReactorCpus(int id) const
 {
-    assert(fd > 0);
-    users_[fd].Initialization(fd, address);
-    if (timeout_MS_ > 0) // 加入到定时器链表中
+    if (reactor_cpus_.empty())
     {
-        timer_->Add(fd, timeout_MS_, std::bind(&WebServer::CloseConnection, this, std::ref(users_[fd])));
+        return {};
     }
-    epoller_->AddFd(fd, listen_event_ | EPOLLIN);
-    SetNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    return {reactor_cpus_[id % reactor_cpus_.size()]};
 }
 
-void WebServer::CloseConnection(HttpConnection &client)
+bool WebServer::InitEventLoops()
 {
-    assert(client.GetFd() > 0);
-    LOG_INFO("Client[%d] quit!", client.GetFd());
-    epoller_->DeleteFd(client.GetFd());
-    client.Close();
+    std::vector<int> inherited_fds = GetInheritedFds();
+    for (int i = 0; i < reactor_num_; ++i)
+    {
+        loops_.emplace_back(EventLoop::Create(io_backend_, i, loop_option_, thread_pool_.get(), users_.get()));
+        if (!loops_.back()->InitSocket(static_cast<size_t>(i) < inherited_fds.size() ? inherited_fds[i] : -1))
+        {
+            LOG_ERROR("Loop[%d] init socket error!", i);
+            return false;
+        }
+    }
+    // 事件循环比旧进程少时，多出来的监听 socket 用不上，其全连接队列中的连接会被重置
+    for (size_t i = reactor_num_; i < inherited_fds.size(); ++i)
+    {
+        LOG_WARN("Inherited listen fd %d is not used, close it", inherited_fds[i]);
+        close(inherited_fds[i]);
+    }
+    return true;
 }
 
-void WebServer::UpdateClientTimeout(HttpConnection &client)
+std::vector<int> WebServer::GetInheritedFds()
 {
-    assert(client.GetFd() > 0);
-    if (timeout_MS_ > 0)
+    std::vector<int> fds;
+    const char *pid = getenv("LISTEN_PID");
+    const char *num = getenv("LISTEN_FDS");
+    if (pid && num && atoi(pid) == getpid())
     {
-        timer_->AdjustTime(client.GetFd(), timeout_MS_);
+        for (int i = 0; i < atoi(num); ++i)
+        {
+            fds.push_back(LISTEN_FDS_START_ + i);
+        }
     }
+    // 不再传给之后 fork 的子进程
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return fds;
 }
 
-void WebServer::DealRead(HttpConnection &client)
+bool WebServer::InitSignal()
 {
-    assert(client.GetFd() > 0);
-    UpdateClientTimeout(client);
-    // 使用 bind 将成员函数修改为 void(*)() 的可调用对象（绑定成员函数，必须传递 this），右值 
-    thread_pool_->AddTask(std::bind(&WebServer::ReadTask, this, std::ref(client)));
+    if (pipe2(signal_pipe_, O_CLOEXEC) == -1)
+    {
+        LOG_ERROR("Create signal pipe error!");
+        return false;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigfillset(&action.sa_mask);
+    for (int sig : {SIGUSR2, SIGTERM, SIGCHLD})
+    {
+        if (sigaction(sig, &action, nullptr) == -1)
+        {
+            LOG_ERROR("Set signal %d handler error!", sig);
+            return false;
+        }
+    }
+    return true;
 }
 
-void WebServer::ReadTask(HttpConnection &client)
+void WebServer::SignalHandler(int sig)
 {
-    assert(client.GetFd() > 0);
-    int res = -1, error_num = 0;
-    res = client.Read(error_num);
-    if (res <= 0 && error_num != EAGAIN)
+    // 信号处理函数中只能调用异步信号安全的函数，把信号写入管道交给信号处理线程
+    int save_errno = errno;
+    char msg = static_cast<char>(sig);
+    if (write(signal_pipe_[1], &msg, 1) == -1)
     {
-        CloseConnection(client);
-        return;
+        // 管道满时丢弃信号
     }
-    Process(client);
+    errno = save_errno;
 }
 
-void WebServer::DealWrite(HttpConnection &client)
+void WebServer::DealSignal()
 {
-    assert(client.GetFd() > 0);
-    UpdateClientTimeout(client);
-    thread_pool_->AddTask(std::bind(&WebServer::WriteTask, this, std::ref(client)));
+    char sig = 0;
+    ServerStats *stats = ServerStats::GetInstance();
+    struct pollfd pfd = {signal_pipe_[0], POLLIN, 0};
+    while (true)
+    {
+        int ready = poll(&pfd, 1, stats->GetNextTimeout());
+        if (ready == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ready == 0)
+        {
+            stats->TryReport();
+            continue;
+        }
+        ssize_t len = read(signal_pipe_[0], &sig, 1);
+        if (len == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (len <= 0 || sig == 0)
+        {
+            break;
+        }
+        switch (sig)
+        {
+            case SIGUSR2:
+                if (is_upgrading_)
+                {
+                    LOG_WARN("Upgrade is already in progress");
+                }
+                else
+                {
+                    is_upgrading_ = Upgrade();
+                }
+                break;
+            case SIGTERM:
+                Drain();
+                break;
+            case SIGCHLD:
+            {
+                // 新进程初始化失败退出时回收它，之后允许再次升级
+                int status = 0;
+                pid_t pid;
+                while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+                {
+                    LOG_WARN("New process %d exited, status: %d", pid, status);
+                    is_upgrading_ = false;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
 }
 
-void WebServer::WriteTask(HttpConnection &client)
+bool WebServer::Upgrade()
 {
-    assert(client.GetFd() > 0);
-    int res = -1, error_num = 0;
-    // 由客户端保证在不出错的前提下一次性写完所有数据
-    res = client.Write(error_num);
-    if (client.GetToWriteBytes() == 0)
-    {
-        // 写任务处理完毕
-        if (client.IsKeepAlive())
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0)
+    {
+        LOG_ERROR("Upgrade: get executable path error!");
+        return false;
+    }
+    exe[len] = '\0';
+
+    // fork 之后的子进程只能调用异步信号安全的函数，参数和环境变量都在这里准备好
+    std::vector<int> listen_fds;
+    for (auto &loop : loops_)
+    {
+        if (loop->GetListenFd() >= 0)
         {
-            Process(client);
-            return;
+            listen_fds.push_back(loop->GetListenFd());
         }
     }
-    if (res < 0 && error_num == EAGAIN)
+    int fd_num = static_cast<int>(listen_fds.size());
+    std::vector<int> tmp_fds(listen_fds.size());
+    std::vector<std::string> envs;
+    for (char **env = environ; *env; ++env)
     {
-        // 继续传输
-        epoller_->ModifyFd(client.GetFd(), connection_event_ | EPOLLOUT);
-        return;
+        if (strncmp(*env, "LISTEN_", 7) != 0 && strncmp(*env, "WEBSERVER_UPGRADE_PARENT=", 25) != 0)
+        {
+            envs.emplace_back(*env);
+        }
     }
-    CloseConnection(client);
-}
+    envs.push_back("WEBSERVER_UPGRADE_PARENT=" + std::to_string(getpid()));
+    envs.push_back("LISTEN_FDS=" + std::to_string(fd_num));
+    envs.push_back("LISTEN_PID=" + std::string(20, '0'));    // 子进程的 pid 在 fork 之后填写
+    std::vector<char *> envp;
+    for (auto &env : envs)
+    {
+        envp.push_back(&env[0]);
+    }
+    envp.push_back(nullptr);
+    char *pid_str = envp[envp.size() - 2] + strlen("LISTEN_PID=");
+    char *argv[] = {exe, nullptr};
+    long max_fd = sysconf(_SC_OPEN_MAX);
 
-void WebServer::Process(HttpConnection &client)
-{
-    if (client.Process())
+    pid_t pid = fork();
+    if (pid == -1)
     {
-        epoller_->ModifyFd(client.GetFd(), connection_event_ | EPOLLOUT);
+        LOG_ERROR("Upgrade: fork error: %s", strerror(errno));
+        return false;
     }
-    else
+    if (pid == 0)
     {
-        epoller_->ModifyFd(client.GetFd(), connection_event_ | EPOLLIN);
+        // 先复制到 3+n 之后，避免 dup2 覆盖还没移动的监听 socket；dup 出来的 fd 不带 close-on-exec
+        for (int i = 0; i < fd_num; ++i)
+        {
+            tmp_fds[i] = fcntl(listen_fds[i], F_DUPFD, LISTEN_FDS_START_ + fd_num);
+        }
+        for (int i = 0; i < fd_num; ++i)
+        {
+            dup2(tmp_fds[i], LISTEN_FDS_START_ + i);
+        }
+        // 其余 fd（epoll、日志、数据库连接、客户端连接等）都不交给新进程
+#ifdef __NR_close_range
+        if (syscall(__NR_close_range, LISTEN_FDS_START_ + fd_num, ~0U, 0) == -1)
+#endif
+        {
+            for (long fd = LISTEN_FDS_START_ + fd_num; fd < max_fd; ++fd)
+            {
+                close(fd);
+            }
+        }
+        char digits[20];
+        int n = 0;
+        for (pid_t self = getpid(); self > 0; self /= 10)
+        {
+            digits[n++] = static_cast<char>('0' + self % 10);
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            pid_str[i] = digits[n - 1 - i];
+        }
+        pid_str[n] = '\0';
+        execve(exe, argv, envp.data());
+        _exit(127);
     }
+    LOG_INFO("Upgrade: start new process %d (%s) with %d listen sockets", pid, exe, fd_num);
+    return true;
 }
 
-void WebServer::SendError(int fd, const std::string &erro_info)
+void WebServer::Drain()
 {
-    assert(fd > 0);
-    if (send(fd, erro_info.c_str(), erro_info.size(), 0) == -1)
+    LOG_INFO("========== Drain connections ==========");
+    HttpConnection::is_draining_ = true;
+    for (auto &loop : loops_)
     {
-        LOG_WARN("send error to client[%d] !", fd);
+        loop->Drain();
     }
-    close(fd);
-}
-
-bool WebServer::SetNonblock(int fd)
-{
-    assert(fd > 0);
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
 }
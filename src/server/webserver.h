@@ -5,12 +5,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string>
-#include <unordered_map>
-
-#include "../thread_pool/thread_pool.h"
+#include <vector>
+#include <thread>
+#include <csignal>
+#include <climits>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <poll.h>
+
+#include "event_loop.h"
+#include "cpu_topology.h"
 #include "../epoller/epoller.h"
-#include "../http/http_connection.h"
-#include "../timer/heap_timer.h"
 #include "../log/log.h"
 #include "../mysql_connection_pool/mysql_connection_pool.h"
 #include "../json/json.h"
@@ -23,78 +28,88 @@ public:
 
     ~WebServer();
 
-    // 启动服务器，调用 epoll_wait() 监听事件
+    // 启动服务器：其余事件循环各自运行在独立线程中，0 号事件循环运行在主线程
+    // 所有事件循环排空退出后返回
     void Start();
 
-private: // 主线程调用的函数
+private:
     // 根据传入的参数设置客户和监听的默认触发模式 (是否ET，并设置其它事件)
     // 0 表示不设置ET；1 表示设置来连接的ET；2 表示设置监听 ET；3以及其它情况表示连接和监听都设置 ET
     void InitEventMode(int trigger_mode); 
 
-    // 初始化socket，完成绑定，监听操作
-    bool InitSocket();
-    
-    // 当检测到有新的连接时，接受连接并进行相应的处理
-    void DealListen();
+    // 创建 reactor_num_ 个事件循环并完成各自监听 socket 的初始化，优先使用从旧进程继承的监听 socket
+    bool InitEventLoops();
 
-    // 初始化一个 HttpConnection 对象，并加入到 epoll 对象中监听
-    void AddClient(int fd, const sockaddr_in &address);
+    // 读取 Server.affinity，把线程池、日志和数据库连接池的线程绑定到配置的 CPU 上
+    void InitAffinity(Json &affinity);
 
-    // 关闭一个客户端的连接，从 epoll 对象中删除并调用客户端的 Close()
-    void CloseConnection(HttpConnection &client);
+    // 读取 Http.routes 和 Http.mime_types，加入请求路由表和文件类型表；配置有误时保留默认的表
+    void InitHttpTables(Json &http);
 
-    // 当跟客户端发生了活动后，更新客户端的超时时间
-    void UpdateClientTimeout(HttpConnection &client);
+    // 读取 Http.file_cache，开启资源目录的文件映射缓存
+    void InitFileCache(Json &file_cache);
 
-    // 更新当前客户的最近访问时间，并将读任务 (ReadTask) 交给工作队列，让子线程去处理
-    void DealRead(HttpConnection &client);
+    // 读取 Http.send_mode 和 Http.sendfile_min_size，选择文件内容的发送方式；sendfile 只用于 epoll 后端
+    void InitSendMode(Json &http);
 
-    // 更新当前客户的最近访问时间，并将写任务 (WriteTask) 交给工作队列，让子线程去处理
-    void DealWrite(HttpConnection &client);
+    // 取出 JSON 对象中值为字符串的项
+    static std::vector<std::pair<std::string, std::string>> GetStringPairs(Json &object);
 
-    // 发送错误信息
-    void SendError(int fd, const std::string &erro_info);
+    // id 号事件循环绑定的 CPU：按编号轮流分配 reactor_cpus_ 中的一个 CPU，未配置时为空
+    std::vector<int> GetReactorCpus(int id) const;
 
-    // 设置文件描述符的属性为非阻塞
-    bool SetNonblock(int fd);
+    // 按 systemd 的 socket activation 约定取得继承的监听 socket：LISTEN_PID 为本进程时，fd 3 ~ 3+LISTEN_FDS-1
+    static std::vector<int> GetInheritedFds();
 
-private: // 子线程调用的函数
-    // 调用 HttpConnection 的 Read()，读取成功的话对读取的请求进行处理
-    void ReadTask(HttpConnection &client);
+    // 安装信号处理函数，信号通过管道转交给信号处理线程 (self-pipe)
+    bool InitSignal();
 
-    // 调用 HttpConnection 的 Write
-    void WriteTask(HttpConnection &client);
+    static void SignalHandler(int sig);
 
-    // 调用 HttpConnection 的 Process，解析请求并生成响应。若成功则修改监听事件为写事件，否则继续监听读事件
-    void Process(HttpConnection &client);
+    // 信号处理线程：SIGUSR2 启动新进程并交出监听 socket；SIGTERM 排空连接后退出
+    // 等待信号时以下次打印运行指标的时间为超时，超时后打印，即使所有事件循环都没有事件也按周期打印
+    void DealSignal();
 
-private:
+    // fork 并 exec 当前程序，新进程继承所有监听 socket，初始化完成后向本进程发送 SIGTERM
+    bool Upgrade();
 
-    static const int MAX_FD_ = 64435;
+    // 让所有事件循环停止 accept 并排空连接
+    void Drain();
 
-    int port_;
+private:
+    static const int MAX_FD_ = 64435;
 
-    int listen_fd_;
+    static const int LISTEN_FDS_START_ = 3;     // socket activation 约定的第一个监听 socket
 
-    int timeout_MS_;            // 超时时间
+    static int signal_pipe_[2];                 // 信号处理函数写端，信号处理线程读端
 
     bool is_close_;
 
-    bool open_linger_;          // 是否启用linger功能
+    int reactor_num_;           // 事件循环（反应堆）的数目
+
+    std::string io_backend_;    // 事件循环使用的 I/O 后端，"epoll" 或 "io_uring"
 
     std::string resource_dir_;  // 资源地址
 
-    uint32_t listen_event_;     // 默认的服务器的监听事件
+    LoopOption loop_option_;    // 所有事件循环共用的运行参数
+
+    std::vector<int> reactor_cpus_;     // 事件循环线程可用的 CPU，为空表示不绑定
+
+    std::vector<int> worker_cpus_;      // 线程池线程绑定的 CPU 集合
 
-    uint32_t connection_event_; // 默认的客户端连接的监听事件
+    std::vector<int> background_cpus_;  // 日志、数据库连接池和信号处理线程绑定的 CPU 集合
 
     std::unique_ptr<ThreadPool> thread_pool_;
 
-    std::unique_ptr<Epoller> epoller_;
-    
-    std::unique_ptr<HeapTimer> timer_;
+    std::unique_ptr<ConnectionSlab> users_;     // 以 fd 为下标的连接数组，所有事件循环共享
+
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+
+    std::vector<std::thread> loop_threads_;
+
+    std::thread signal_thread_;
 
-    std::unordered_map<int, HttpConnection> users_;
+    bool is_upgrading_;         // 是否已经 fork 出了新进程，避免重复升级
 };
 
 /*
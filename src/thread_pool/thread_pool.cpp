@@ -1,16 +1,25 @@
 #include "thread_pool.h"
 
-ThreadPool::ThreadPool(size_t thread_num) : pool_(std::make_shared<Pool>())
+ThreadPool::ThreadPool(size_t thread_num, int target_delay_MS, int interval_MS, size_t max_queue_size) :
+        pool_(std::make_shared<Pool>())
 {
     assert(thread_num > 0);
     pool_->is_stop = false;
+    pool_->target_delay = std::chrono::milliseconds(target_delay_MS);
+    pool_->interval = std::chrono::milliseconds(interval_MS);
+    pool_->max_queue_size = max_queue_size;
+    pool_->is_above_target = false;
+    pool_->is_overloaded = false;
+    pool_->queue_delay_us = 0;
     // 创建线程并进行线程分离
     for (size_t i = 0; i < thread_num; ++i)
     {
         // c++ 的 std::thread 可以灵活的使用不同签名的工作函数
         // c 的 pthread.h 只接受 void *(*)(void *) 签名的函数 （要将工作函数设为全局函数或者静态成员函数）
         // 传递一个函数指针，并将 this 指针做为参数传递给它（成员函数有默认的this指针做为参数）
-        std::thread(&ThreadPool::Work, this).detach();
+        std::thread worker(&ThreadPool::Work, this);
+        threads_.push_back(worker.native_handle());
+        worker.detach();
     }
 }
 
@@ -33,7 +42,8 @@ void ThreadPool::Work()
     {
         if (!pool_->tasks.empty())
         {
-            auto task = std::move(pool_->tasks.front());
+            auto task = std::move(pool_->tasks.front().func);
+            UpdateOverload(pool_->tasks.front().enqueue_time);
             pool_->tasks.pop();
             locker.unlock(); // 解锁，让其他线程也可以去取任务工作
             task();          // 因为工作队列中保存的就是可调用对象，可以直接执行任务
@@ -44,3 +54,29 @@ void ThreadPool::Work()
     }
 }
 
+void ThreadPool::UpdateOverload(const TimePoint &enqueue_time)
+{
+    TimePoint now = std::chrono::steady_clock::now();
+    auto delay = now - enqueue_time;
+    pool_->queue_delay_us = std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+    if (pool_->target_delay.count() <= 0)
+    {
+        return;
+    }
+    // 排队时间低于目标值或取完这个任务后队列为空，说明积压已经消化，解除过载
+    // 只看排队时间而不看队列长度：短暂的突发会很快排空，不会被误判为过载
+    if (delay < pool_->target_delay || pool_->tasks.size() <= 1)
+    {
+        pool_->is_above_target = false;
+        pool_->is_overloaded = false;
+    }
+    else if (!pool_->is_above_target)
+    {
+        pool_->is_above_target = true;
+        pool_->overload_time = now + pool_->interval;
+    }
+    else if (now >= pool_->overload_time)
+    {
+        pool_->is_overloaded = true;
+    }
+}
@@ -7,6 +7,9 @@
 #include <thread>
 #include <functional>
 #include <cassert>
+#include <chrono>
+#include <atomic>
+#include <vector>
 
 #include <iostream>
 
@@ -15,26 +18,74 @@ class ThreadPool
 public:
     ThreadPool() = default;
 
-    explicit ThreadPool(size_t thread_num = 8);
+    // target_delay_MS > 0 时开启准入控制：任务的排队时间在 interval_MS 内一直高于 target_delay_MS，
+    // 说明线程池已经过载 (CoDel)，TryAddTask() 拒绝新任务，直到排队时间回落；max_queue_size > 0 时限制队列长度
+    explicit ThreadPool(size_t thread_num = 8, int target_delay_MS = 0, int interval_MS = 100, size_t max_queue_size = 0);
 
     ~ThreadPool();
 
     void Work();
 
+    // 添加任务，不受准入控制的限制
     template<typename T>
     void AddTask(T&& task);
 
+    // 线程池过载或队列已满时不添加任务并返回 false，由调用者拒绝这个请求
+    template<typename T>
+    bool TryAddTask(T&& task);
+
+    // 线程池是否处于过载状态
+    bool IsOverloaded() const
+    {
+        return pool_->is_overloaded;
+    }
+
+    // 最近一个被取出的任务的排队时间（us）
+    int64_t GetQueueDelay() const
+    {
+        return pool_->queue_delay_us;
+    }
+
+    // 子线程的句柄，用于设置 CPU 亲和性（子线程已分离，但在线程池的整个生命周期内一直运行）
+    const std::vector<std::thread::native_handle_type> &GetThreads() const
+    {
+        return threads_;
+    }
+
 private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    // 任务，记录入队时间用于计算排队时间
+    struct Task
+    {
+        std::function<void()> func;
+        TimePoint enqueue_time;
+    };
+
     // 结构体，池子
     struct Pool
     {
         std::mutex mtx;                         // 互斥锁
         std::condition_variable cond;             // 条件变量
         bool is_stop;                             // 线程池是否停止
-        std::queue<std::function<void()>> tasks;  // 任务队列，存储无参且返回值为 void 的可调用对象 （待执行的任务）
+        std::queue<Task> tasks;                   // 任务队列，存储无参且返回值为 void 的可调用对象 （待执行的任务）
+
+        // 准入控制，除原子变量外都由 mtx 保护
+        std::chrono::milliseconds target_delay;   // 可接受的排队时间
+        std::chrono::milliseconds interval;       // 排队时间持续高于 target_delay 多久后判定为过载
+        size_t max_queue_size;                    // 队列长度上限，0 表示不限制
+        bool is_above_target;                     // 排队时间是否已经高于 target_delay
+        TimePoint overload_time;                  // 排队时间持续高于 target_delay 到这个时间点时判定为过载
+        std::atomic<bool> is_overloaded;
+        std::atomic<int64_t> queue_delay_us;
     };
+
+    // 子线程取出任务时根据它的排队时间更新过载状态，调用时需持有 mtx
+    void UpdateOverload(const TimePoint &enqueue_time);
     
     std::shared_ptr<Pool> pool_; // 池子
+
+    std::vector<std::thread::native_handle_type> threads_;
 };
 
 template<typename T>
@@ -43,9 +94,32 @@ void ThreadPool::AddTask(T&& task)
     {
         std::lock_guard<std::mutex> locker(pool_->mtx);
         // 使用 std::forward<T> 实现完美转发，确保参数的值类别保持不变。
-        pool_->tasks.emplace(std::forward<T>(task));
+        pool_->tasks.push({std::forward<T>(task), std::chrono::steady_clock::now()});
+    }
+    pool_->cond.notify_one();
+}
+
+template<typename T>
+bool ThreadPool::TryAddTask(T&& task)
+{
+    {
+        std::lock_guard<std::mutex> locker(pool_->mtx);
+        if (pool_->is_overloaded || (pool_->max_queue_size > 0 && pool_->tasks.size() >= pool_->max_queue_size))
+        {
+            return false;
+        }
+        TimePoint now = std::chrono::steady_clock::now();
+        // 子线程全部阻塞时不会有任务出队、也就不会更新过载状态，队首任务等得太久同样判定为过载
+        if (pool_->target_delay.count() > 0 && !pool_->tasks.empty() &&
+            now - pool_->tasks.front().enqueue_time > pool_->target_delay + pool_->interval)
+        {
+            pool_->is_overloaded = true;
+            return false;
+        }
+        pool_->tasks.push({std::forward<T>(task), now});
     }
     pool_->cond.notify_one();
+    return true;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "uring.h"
+
+IoUring::IoUring(unsigned entries) : ring_fd_(-1), sq_ptr_(MAP_FAILED), sq_ring_size_(0), sqes_(nullptr),
+        sqes_size_(0), sq_entries_(0), sqe_head_(0), sqe_tail_(0), cq_ptr_(MAP_FAILED), cq_ring_size_(0),
+        buf_ring_(nullptr), buf_ring_size_(0), buf_base_(nullptr), buf_count_(0), buf_size_(0), buf_group_(0)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 只有事件循环线程提交请求，允许内核据此省去部分同步开销
+    // 环由主线程创建，先以禁用状态创建，等事件循环线程启用后由它成为提交者
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_R_DISABLED;
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+    {
+        return;
+    }
+    ring_fd_ = fd;
+    sq_entries_ = params.sq_entries;
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // 5.4 之后 SQ 和 CQ 可以共用一次 mmap
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ptr_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+    {
+        close(ring_fd_);
+        ring_fd_ = -1;
+        return;
+    }
+    cq_ptr_ = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ptr_ :
+        mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        close(ring_fd_);
+        ring_fd_ = -1;
+        return;
+    }
+    sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    sqe_head_ = sqe_tail_ = *sq_tail_;
+}
+
+IoUring::~IoUring()
+{
+    if (buf_ring_)
+    {
+        munmap(buf_ring_, buf_ring_size_);
+        delete[] buf_base_;
+    }
+    if (sqes_)
+    {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+    {
+        munmap(cq_ptr_, cq_ring_size_);
+    }
+    if (sq_ptr_ != MAP_FAILED)
+    {
+        munmap(sq_ptr_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0)
+    {
+        close(ring_fd_);
+    }
+}
+
+bool IoUring::Enable()
+{
+    return syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) == 0;
+}
+
+struct io_uring_sqe *IoUring::GetSqe()
+{
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_)
+    {
+        // 提交队列已满，先交给内核处理
+        SubmitAndWait(0);
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head >= sq_entries_)
+        {
+            return nullptr;
+        }
+    }
+    struct io_uring_sqe *sqe = &sqes_[sqe_tail_ & *sq_mask_];
+    ++sqe_tail_;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned IoUring::FlushSq()
+{
+    unsigned tail = *sq_tail_;
+    unsigned to_submit = sqe_tail_ - sqe_head_;
+    for (; sqe_head_ != sqe_tail_; ++sqe_head_, ++tail)
+    {
+        sq_array_[tail & *sq_mask_] = sqe_head_ & *sq_mask_;
+    }
+    // release 语义保证内核看到新的 tail 时提交项的内容已经写好
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    return to_submit;
+}
+
+int IoUring::SubmitAndWait(unsigned wait_nr, int timeout_ms)
+{
+    unsigned to_submit = FlushSq();
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if (wait_nr > 0 && timeout_ms >= 0)
+    {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<unsigned long long>(&ts);
+        return Enter(to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    if (to_submit == 0 && wait_nr == 0)
+    {
+        return 0;
+    }
+    return Enter(to_submit, wait_nr, flags, nullptr, 0);
+}
+
+int IoUring::Enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size)
+{
+    int res = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, arg_size);
+    // 超时 (ETIME) 和被信号打断 (EINTR) 都不算错误
+    if (res < 0 && (errno == ETIME || errno == EINTR))
+    {
+        return 0;
+    }
+    return res;
+}
+
+bool IoUring::SetupBufferRing(unsigned short group, unsigned count, unsigned size)
+{
+    // 缓冲区个数必须是 2 的幂
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768 || size == 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    buf_ring_size_ = count * sizeof(struct io_uring_buf);
+    void *ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        return false;
+    }
+    buf_ring_ = static_cast<struct io_uring_buf_ring *>(ring);
+    buf_base_ = new char[static_cast<size_t>(count) * size];
+    buf_count_ = count;
+    buf_size_ = size;
+    buf_group_ = group;
+    // 先在用户态写好所有缓冲区描述，再注册给内核（tail 为 0，内核此时还看不到任何缓冲区）
+    for (unsigned i = 0; i < count; ++i)
+    {
+        struct io_uring_buf *buf = GetBufferEntry(i);
+        buf->addr = reinterpret_cast<unsigned long long>(GetBuffer(i));
+        buf->len = size;
+        buf->bid = i;
+    }
+    buf_ring_->tail = 0;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<unsigned long long>(ring);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        munmap(ring, buf_ring_size_);
+        delete[] buf_base_;
+        buf_ring_ = nullptr;
+        buf_base_ = nullptr;
+        buf_count_ = 0;
+        return false;
+    }
+    __atomic_store_n(&buf_ring_->tail, static_cast<unsigned short>(count), __ATOMIC_RELEASE);
+    return true;
+}
+
+void IoUring::RecycleBuffer(unsigned short bid)
+{
+    unsigned short tail = buf_ring_->tail;
+    struct io_uring_buf *buf = GetBufferEntry(tail & (buf_count_ - 1));
+    buf->addr = reinterpret_cast<unsigned long long>(GetBuffer(bid));
+    buf->len = buf_size_;
+    buf->bid = bid;
+    __atomic_store_n(&buf_ring_->tail, static_cast<unsigned short>(tail + 1), __ATOMIC_RELEASE);
+}
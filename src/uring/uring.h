@@ -0,0 +1,129 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <signal.h>
+#include <ctime>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+#include <algorithm>
+
+// 对 io_uring 系统调用的简单封装（不依赖 liburing）
+// 提交队列 (SQ) 和完成队列 (CQ) 都只允许调用 Enable() 的事件循环线程访问
+class IoUring
+{
+public:
+    explicit IoUring(unsigned entries = 4096);
+
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+
+    IoUring &operator = (const IoUring &) = delete;
+
+    // 环是否创建成功：内核不支持 io_uring（低于 6.0 时不支持 IORING_SETUP_SINGLE_ISSUER），或者容器、seccomp 禁止 io_uring_setup 时失败
+    bool IsValid() const
+    {
+        return ring_fd_ >= 0;
+    }
+
+    // 环在创建时处于禁用状态，由事件循环线程调用 Enable() 后成为唯一的提交线程
+    bool Enable();
+
+    // 取出一个空闲的提交项并清零，队列满时先提交已有的提交项再取
+    struct io_uring_sqe *GetSqe();
+
+    // 提交所有提交项，并等待至少 wait_nr 个完成项，timeout_ms < 0 表示一直等待
+    int SubmitAndWait(unsigned wait_nr, int timeout_ms = -1);
+
+    // 完成队列中是否有还未处理的完成项（不进入内核）
+    bool HasCqe() const
+    {
+        return *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    }
+
+    // 把完成队列中已有的完成项依次交给 func 处理，返回处理的个数
+    template<typename Func>
+    unsigned ForEachCqe(Func &&func);
+
+    // 注册一组由内核挑选的接收缓冲区 (provided buffer ring)，共 count 个，每个 size 字节；内核低于 5.19 时失败
+    bool SetupBufferRing(unsigned short group, unsigned count, unsigned size);
+
+    // 返回编号为 bid 的接收缓冲区
+    char *GetBuffer(unsigned short bid)
+    {
+        assert(bid < buf_count_);
+        return buf_base_ + static_cast<size_t>(bid) * buf_size_;
+    }
+
+    // 接收完成后把缓冲区还给内核
+    void RecycleBuffer(unsigned short bid);
+
+    unsigned short GetBufferGroup() const
+    {
+        return buf_group_;
+    }
+
+    unsigned GetBufferSize() const
+    {
+        return buf_size_;
+    }
+
+private:
+    int Enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size);
+
+    // 把本地累积的提交项发布给内核（更新 SQ 的 tail）
+    unsigned FlushSq();
+
+    // 接收缓冲区环中的第 index 项
+    // 注意不能用 buf_ring_->bufs：C++ 中头文件里的柔性数组前有一个空结构体，bufs 的偏移是 8 而不是 0
+    struct io_uring_buf *GetBufferEntry(unsigned index)
+    {
+        return reinterpret_cast<struct io_uring_buf *>(buf_ring_) + index;
+    }
+
+    int ring_fd_;
+
+    // 提交队列
+    void *sq_ptr_;
+    size_t sq_ring_size_;
+    unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    struct io_uring_sqe *sqes_;
+    size_t sqes_size_;
+    unsigned sq_entries_;
+    unsigned sqe_head_, sqe_tail_;  // 本地已取出 / 已发布的提交项位置
+
+    // 完成队列
+    void *cq_ptr_;
+    size_t cq_ring_size_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    struct io_uring_cqe *cqes_;
+
+    // 接收缓冲区
+    struct io_uring_buf_ring *buf_ring_;
+    size_t buf_ring_size_;
+    char *buf_base_;
+    unsigned buf_count_, buf_size_;
+    unsigned short buf_group_;
+};
+
+template<typename Func>
+unsigned IoUring::ForEachCqe(Func &&func)
+{
+    unsigned head = *cq_head_;
+    // 读取 tail 需要 acquire 语义，确保能看到内核写好的完成项内容
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    for (; head != tail; ++head, ++count)
+    {
+        func(cqes_[head & *cq_mask_]);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+#endif
@@ -44,11 +44,13 @@ int force_reload=0;
 int proxyport=80;
 char *proxyhost=NULL;
 int benchtime=30;
+int pipeline=1; /* requests sent back to back on each connection */
 /* internal */
 int mypipe[2];
 char host[MAXHOSTNAMELEN];
 #define REQUEST_SIZE 2048
 char request[REQUEST_SIZE];
+char *requests=request; /* what is written on each connection, request repeated pipeline times */
 
 static const struct option long_options[]=
 {
@@ -66,6 +68,7 @@ static const struct option long_options[]=
  {"version",no_argument,NULL,'V'},
  {"proxy",required_argument,NULL,'p'},
  {"clients",required_argument,NULL,'c'},
+ {"pipeline",required_argument,NULL,'P'},
  {NULL,0,NULL,0}
 };
 
@@ -88,6 +91,7 @@ static void usage(void)
 	"  -t|--time <sec>          Run benchmark for <sec> seconds. Default 30.\n"
 	"  -p|--proxy <server:port> Use proxy server for request.\n"
 	"  -c|--clients <n>         Run <n> HTTP clients at once. Default one.\n"
+	"  -P|--pipeline <n>        Send <n> pipelined HTTP/1.1 requests per connection.\n"
 	"  -9|--http09              Use HTTP/0.9 style requests.\n"
 	"  -1|--http10              Use HTTP/1.0 protocol.\n"
 	"  -2|--http11              Use HTTP/1.1 protocol.\n"
@@ -111,7 +115,7 @@ int main(int argc, char *argv[])
           return 2;
  } 
 
- while((opt=getopt_long(argc,argv,"912Vfrt:p:c:?h",long_options,&options_index))!=EOF )
+ while((opt=getopt_long(argc,argv,"912Vfrt:p:c:P:?h",long_options,&options_index))!=EOF )
  {
   switch(opt)
   {
@@ -147,6 +151,7 @@ int main(int argc, char *argv[])
    case 'h':
    case '?': usage();return 2;break;
    case 'c': clients=atoi(optarg);break;
+   case 'P': pipeline=atoi(optarg);break;
   }
  }
  
@@ -157,6 +162,7 @@ int main(int argc, char *argv[])
                     }
 
  if(clients==0) clients=1;
+ if(pipeline<1) pipeline=1;
  if(benchtime==0) benchtime=60;
  /* Copyright */
  fprintf(stderr,"Webbench - Simple Web Benchmark "PROGRAM_VERSION"\n"
@@ -192,6 +198,7 @@ int main(int argc, char *argv[])
  if(force) printf(", early socket close");
  if(proxyhost!=NULL) printf(", via proxy server %s:%d",proxyhost,proxyport);
  if(force_reload) printf(", forcing reload");
+ if(pipeline>1) printf(", %d pipelined requests per connection",pipeline);
  printf(".\n");
  return bench();
 }
@@ -200,6 +207,7 @@ void build_request(const char *url)
 {
   char tmp[10];
   int i;
+  size_t keep_len;
 
   bzero(host,MAXHOSTNAMELEN);
   bzero(request,REQUEST_SIZE);
@@ -208,6 +216,7 @@ void build_request(const char *url)
   if(method==METHOD_HEAD && http10<1) http10=1;
   if(method==METHOD_OPTIONS && http10<2) http10=2;
   if(method==METHOD_TRACE && http10<2) http10=2;
+  if(pipeline>1 && http10<2) http10=2;
 
   switch(method)
   {
@@ -283,10 +292,27 @@ void build_request(const char *url)
   {
 	  strcat(request,"Pragma: no-cache\r\n");
   }
+  keep_len=strlen(request);
   if(http10>1)
 	  strcat(request,"Connection: close\r\n");
   /* add empty line at end */
   if(http10>0) strcat(request,"\r\n"); 
+  if(pipeline>1)
+  {
+	  /* the first pipeline-1 copies keep the connection open, the last one asks the server to close it */
+	  requests=malloc((keep_len+2)*(pipeline-1)+strlen(request)+1);
+	  if(requests==NULL)
+	  {
+		  perror("malloc failed.");
+		  exit(3);
+	  }
+	  for(i=0;i<pipeline-1;i++)
+	  {
+		  memcpy(requests+(keep_len+2)*i,request,keep_len);
+		  memcpy(requests+(keep_len+2)*i+keep_len,"\r\n",2);
+	  }
+	  strcpy(requests+(keep_len+2)*(pipeline-1),request);
+  }
   // printf("Req=%s\n",request);
 }
 
@@ -342,9 +368,9 @@ static int bench(void)
   {
     /* I am a child */
     if(proxyhost==NULL)
-      benchcore(host,proxyport,request);
+      benchcore(host,proxyport,requests);
          else
-      benchcore(proxyhost,proxyport,request);
+      benchcore(proxyhost,proxyport,requests);
 
          /* write results to pipe */
 	 f=fdopen(mypipe[1],"w");
@@ -447,6 +473,6 @@ void benchcore(const char *host,const int port,const char *req)
 	    }
     }
     if(close(s)) {failed++;continue;}
-    speed++;
+    speed+=pipeline;
  }
 }